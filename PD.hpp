@@ -1,10 +1,18 @@
-#include <folly/experimental/Select64.h>
+#pragma once
 
 #include <algorithm>
 #include <atomic>
 #include <bit>
 #include <cinttypes>
 #include <cstring>
+#include <functional>
+#include <immintrin.h>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "pd_array.hpp"
+#include "stats.hpp"
 
 namespace FELRU {
 
@@ -22,6 +30,11 @@ struct spin_lock {
   void unlock() { flag.clear(std::memory_order_release); }
 };
 
+struct no_lock {
+  void lock() {}
+  void unlock() {}
+};
+
 // Static cast of pointer
 // Can be overloaded to compress with known allocator
 struct ptr {
@@ -33,14 +46,29 @@ struct ptr {
   type getRaw() const noexcept { return raw; }
 };
 
+// position of the s-th set bit of el, counting from 0
+inline uint16_t select(uint64_t el, uint16_t s) {
+#if __BMI2__
+  return static_cast<uint16_t>(std::countr_zero(_pdep_u64(1UL << s, el)));
+#else
+  // reference : https://vigna.di.unimi.it/ftp/papers/Broadword.pdf
+  const uint64_t L8 = 0x0101'0101'0101'0101UL;
+  const uint64_t H8 = 0x8080'8080'8080'8080UL;
+  uint64_t c = el - ((el >> 1) & 0x5555'5555'5555'5555UL);
+  c = (c & 0x3333'3333'3333'3333UL) + ((c >> 2) & 0x3333'3333'3333'3333UL);
+  c = ((c + (c >> 4)) & 0x0f0f'0f0f'0f0f'0f0fUL) * L8;  // byte i: ones in bytes 0..i
+
+  // bytes holding at most s ones in total precede the one we are after
+  uint16_t byte = std::popcount((((s * L8) | H8) - c) & H8);
+  uint16_t rank = byte ? (c >> (8 * byte - 8)) & 0xff : 0;
+  uint64_t bits = (el >> (8 * byte)) & 0xff;
+  for (s -= rank; s; --s) bits &= bits - 1;
+  return static_cast<uint16_t>(8 * byte + std::countr_zero(bits));
+#endif
+}
+
 template <typename Ptr, typename LockT>
 struct PD {
-  template <class Instructions = folly::compression::instructions::Default>
-  static inline uint16_t select(uint64_t el, uint16_t s) {
-    uint64_t sel = folly::select64<Instructions>(el, static_cast<uint64_t>(s));
-    return static_cast<uint16_t>(sel);
-  }
-
   struct element {
     uint16_t index : 5;
     uint16_t fp : 11;
@@ -48,7 +76,7 @@ struct PD {
 
   uint64_t header = 0xffff'ffffUL;
   element bins[27] = {element{0, 0}};
-  int8_t occupancy = 0;
+  int8_t freelist = 0;
   LockT lock;
 
   using PtrType = typename Ptr::type;
@@ -56,6 +84,8 @@ struct PD {
                            10, 11, 12, 13, 14, 15, 16, 17, 18,
                            19, 20, 21, 22, 23, 24, 25, 26, 27};
 
+  size_t occupancy() const { return std::bit_width(header) - 32; }
+
   Ptr find(uint16_t fp) {
     return find(fp, [](PtrType) { return true; });
   }
@@ -81,10 +111,11 @@ struct PD {
     return Ptr(ptr_table[bins[begin].index]);
   }
 
+  // Makes room by evicting when full, see evict
   void insert(uint16_t fp, Ptr key) {
-    if (occupancy >= 27) return;
     uint16_t q = fp & 31U;
     uint16_t r = fp >> 5;
+    if (freelist >= 27) evict(q);
 
     uint16_t sel = q ? (select(header, q - 1) + 1) : 0;
     uint64_t mask = (1UL << sel) - 1;
@@ -94,8 +125,8 @@ struct PD {
     std::memmove(bins + slot + 1, bins + slot,
                  (27 - slot - 1) * sizeof(element));
 
-    uint16_t ptr_slot = occupancy;
-    occupancy = ptr_table[occupancy];
+    uint16_t ptr_slot = freelist;
+    freelist = ptr_table[freelist];
     bins[slot] = {ptr_slot, r};
     ptr_table[ptr_slot] = key.getRaw();
   }
@@ -111,26 +142,98 @@ struct PD {
     auto finder = [this, &raw, &r](element el) {
       return (el.fp == r) && (ptr_table[el.index] == raw);
     };
-    auto slot = std::find_if(bins + begin, bins + end, finder) - bins;
+    uint16_t slot = std::find_if(bins + begin, bins + end, finder) - bins;
     if (slot >= end) return;
 
-    uint64_t mask = (1UL << slot) - 1;
+    erase(slot, 1UL << (slot + q));
+  }
+
+  // Evicts the least recently used element of the first non-empty quotient
+  // after q, wrapping around to q itself last (as bin_dictionary::evict_q).
+  // Returns the evicted pointer.
+  Ptr evict(uint16_t q) {
+    uint64_t pivot = 1UL << select(header, q);
+    uint64_t h = header | (pivot | (pivot - 1));
+    uint64_t front = ~h & (h + 1);
+    if (front > header) front = ~header & (header + 1);
+
+    uint64_t end = header & ~(front - 1);
+    end &= -end;
+    uint64_t victim = end >> 1;
+    uint16_t slot = std::popcount(~header & (victim - 1));
+    auto evicted = Ptr(ptr_table[bins[slot].index]);
+    erase(slot, victim);
+    return evicted;
+  }
+
+  // drops the element in bins[slot], whose zero in the header is bit
+  void erase(uint16_t slot, uint64_t bit) {
+    uint64_t mask = bit - 1;
     header = (header & mask) | ((header >> 1) & ~mask);
 
     auto prev = bins[slot].index;
     std::memmove(bins + slot, bins + slot + 1,
                  (27 - slot - 1) * sizeof(element));
-    ptr_table[prev] = occupancy;
-    occupancy = prev;
+    ptr_table[prev] = freelist;
+    freelist = prev;
   }
 
   template <typename F>
   void for_each(F func) {
-    std::for_each(bins, bins + occupancy, [this, &func](element el) {
+    std::for_each(bins, bins + occupancy(), [this, &func](element el) {
       auto ptr = Ptr(ptr_table[el.index]);
       func(ptr);
     });
   }
 };
 
+// reference : https://github.com/jbapple/crate-dictionary
+// The pointer stored for each key is the key itself, so a fingerprint
+// match is confirmed by comparing it with the looked up key.
+template <typename Hash = std::identity, typename Ptr = ptr,
+          typename LockT = no_lock>
+struct cache {
+  const size_t size;
+  const size_t entries;
+  pd_array<PD<Ptr, LockT>> pds;
+  Hash hasher;
+  [[no_unique_address]] stats::counters counters;
+
+  cache(size_t size) : size(size), entries(size / 27), pds(entries) {}
+  cache(pd_array<PD<Ptr, LockT>> pds)
+      : size(pds.size() * 27), entries(pds.size()), pds(std::move(pds)) {}
+
+  auto set(size_t key, void*) {
+    auto hash = hasher(key);
+    auto& pd_ = pds[hash % entries];
+    uint16_t fp = static_cast<uint16_t>(hash / entries);
+
+    std::lock_guard guard(pd_.lock);
+    bool hit = false;
+    pd_.find(fp, [this, &hit, key](typename Ptr::type raw) {
+      if (raw != key) counters.add(stats::false_matches);
+      return hit = (raw == key);
+    });
+    counters.add(hit ? stats::hits : stats::misses);
+    if (!hit) {
+      counters.add(stats::inserts);
+      if (stats::enabled && pd_.occupancy() >= 27) counters.add(stats::evictions);
+      pd_.insert(fp, Ptr(key));
+    }
+    return hit;
+  }
+
+  stats::snapshot stats() {
+    auto s = counters.read();
+    stats::occupancy(s, pds);
+    return s;
+  }
+
+  void describe() {
+    std::cout
+        << "Cache Eviction Policy: FELRU\n"
+        << "Cache size: " << size << std::endl;
+  }
+};
+
 };  // namespace FELRU
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "cache.hpp"
+
+// Calls fn(key, val) for every entry of an engine, least valuable first,
+// so that setting them in this order into another engine keeps the most
+// valuable ones resident.
+
+template <typename Fn>
+void for_each_entry(lru& c, Fn fn) {
+  for (auto it = c.lru_.rbegin(); it != c.lru_.rend(); ++it)
+    fn(*it, c.table.at(*it).second);
+}
+
+template <typename Fn>
+void for_each_entry(mru& c, Fn fn) {
+  for (auto it = c.mru_.rbegin(); it != c.mru_.rend(); ++it)
+    fn(*it, c.table.at(*it).second);
+}
+
+template <typename Fn>
+void for_each_entry(clock_lru& c, Fn fn) {
+  for (auto it = c.clock_.rbegin(); it != c.clock_.rend(); ++it)
+    fn(it->key, c.table.at(it->key).second);
+}
+
+template <typename Fn>
+void for_each_entry(lfu& c, Fn fn) {
+  for (auto& frame : c.lru_) fn(frame.key, c.table.at(frame.key).second);
+}
+
+template <size_t K, typename Fn>
+void for_each_entry(lru_k<K>& c, Fn fn) {
+  for (auto& frame : c.lru_) fn(frame.key, c.table.at(frame.key).second);
+}
+
+template <class Cache>
+const char* policy_name() {
+  if constexpr (std::is_same_v<Cache, lru>) return "lru";
+  else if constexpr (std::is_same_v<Cache, mru>) return "mru";
+  else if constexpr (std::is_same_v<Cache, lfu>) return "lfu";
+  else if constexpr (std::is_same_v<Cache, clock_lru>) return "clock";
+  else return "lru_k";
+}
+
+// reference : https://www.usenix.org/conference/atc17/technical-sessions/presentation/waldspurger
+// (Waldspurger et al., miniature simulations). Serves from one engine of
+// Policies while a miniature of every candidate replays a spatially
+// sampled share of the keys, 1/512 (more for small caches, so that a
+// miniature holds at least 16 keys), with its capacity scaled by the same
+// rate. A sampled access costs one set() per candidate, so the rate is
+// what keeps the overhead to a few percent. Every epoch the miniatures'
+// hits are compared, and once the same candidate has beaten the current
+// policy by margin for patience epochs in a row, the main cache is
+// rebuilt with it from the resident entries.
+template <class... Policies>
+struct adaptive {
+  using engine = std::variant<Policies...>;
+  static const size_t count = sizeof...(Policies);
+  static const uint64_t scale = 1UL << 24;  // sampling threshold units
+  static const uint64_t golden = 0x9e37'79b9'7f4a'7c15UL;
+
+  const size_t size;
+  const uint64_t threshold;
+  const size_t mini_size;
+  const size_t epoch;
+  const double margin;
+  const size_t patience;
+
+  std::unique_ptr<engine> main;
+  std::tuple<Policies...> minis;
+  std::array<size_t, count> hits{};
+  size_t sampled = 0;
+  size_t challenger = 0;
+  size_t streak = 0;
+  size_t switches = 0;
+
+  adaptive(size_t size, double margin = 0.05, size_t patience = 3)
+      : size(size),
+        threshold(std::min<uint64_t>(scale, std::max<uint64_t>(scale / 512, scale * 16 / size))),
+        mini_size(std::max<size_t>(size * threshold / scale, 1)),
+        epoch(std::max<size_t>(4 * mini_size, 256)),
+        margin(margin), patience(patience),
+        main(std::make_unique<engine>(std::in_place_index<0>, size)),
+        minis(Policies(mini_size)...) {}
+
+  size_t current() const { return main->index(); }
+
+  auto set(size_t key, void* val) {
+    // multiplicative hashing is enough to sample, and costs one multiply
+    if ((key * golden >> 40) < threshold) [[unlikely]] sample(key);
+    return std::visit([key, val](auto& c) { return c.set(key, val); }, *main);
+  }
+
+  void sample(size_t key) {
+    std::apply([this, key](auto&... mini) {
+      size_t i = 0;
+      ((hits[i++] += mini.set(key, nullptr)), ...);
+    }, minis);
+    if (++sampled % epoch == 0) decide();
+  }
+
+  void decide() {
+    auto best = std::max_element(hits.begin(), hits.end()) - hits.begin();
+    auto now = current();
+    bool wins = static_cast<size_t>(best) != now &&
+                hits[best] > hits[now] * (1 + margin) + 1;
+    streak = wins && static_cast<size_t>(best) == challenger ? streak + 1 : wins;
+    challenger = best;
+    hits.fill(0);
+    if (streak >= patience) {
+      migrate(best, std::make_index_sequence<count>());
+      streak = 0;
+    }
+  }
+
+  template <size_t... I>
+  void migrate(size_t to, std::index_sequence<I...>) {
+    std::unique_ptr<engine> next;
+    ((to == I ? (void)(next = std::make_unique<engine>(std::in_place_index<I>, size)) : void()), ...);
+    std::visit([&next](auto& from) {
+      std::visit([&from](auto& into) {
+        for_each_entry(from, [&into](size_t key, void* val) { into.set(key, val); });
+      }, *next);
+    }, *main);
+    main = std::move(next);
+    ++switches;
+  }
+
+  const char* policy() const {
+    const char* names[] = {policy_name<Policies>()...};
+    return names[current()];
+  }
+
+  // of the engine serving now, counted since it took over
+  stats::snapshot stats() {
+    return std::visit([](auto& c) { return c.stats(); }, *main);
+  }
+
+  void describe() {
+    std::cout
+        << "Cache Eviction Policy: adaptive, now " << policy() << '\n'
+        << "Hash table size: " << size << std::endl;
+  }
+};
@@ -1,37 +1,42 @@
+#include <chrono>
 #include <iostream>
 #include <string>
 #include <vector>
 
+#include "PD.hpp"
+#include "adaptive.hpp"
 #include "cache.hpp"
 #include "felru.hpp"
+#include "fifo.hpp"
 #include "io.hpp"
 
 template <class Cache>
-auto hit_rate(std::vector<size_t> trace, Cache cache) {
+auto hit_rate(std::vector<size_t>& trace, Cache& cache) {
   size_t total = trace.size();
   size_t hit = 0;
+  auto start = std::chrono::high_resolution_clock::now();
   for (auto key : trace)
     hit += cache.set(key, nullptr);
+  auto stop = std::chrono::high_resolution_clock::now();
 
   auto ratio = (double)hit / (double)total;
+  auto ns = std::chrono::duration<double, std::nano>(stop - start).count() / total;
 
   std::cout << "  -\n"
             << "    size: " << cache.size << '\n'
-            << "    hit_rate: " << ratio << std::endl;
+            << "    hit_rate: " << ratio << '\n'
+            << "    ns_per_op: " << ns << std::endl;
+  if constexpr (requires { cache.switches; })
+    std::cout << "    switches: " << cache.switches << '\n'
+              << "    policy: " << cache.policy() << std::endl;
+  if constexpr (stats::enabled) cache.stats().dump(std::cout);
 }
 
 int main(int argc, char const* argv[]) {
   if (argc < 2) return 1;
 
-  auto fname = std::string(argv[1]);
-
-  std::vector<size_t> io;
-  if (fname.ends_with(".lis"))
-    io = load_arc(fname);
-  else if (fname.ends_with(".yaml"))
-    io = load_zipf(fname);
-  else
-    io = load_wiki(fname);
+  auto io = load_trace(argv[1]);
+  if (io.empty()) return 1;
 
   std::vector<size_t> sizes;
   sizes.reserve(10);
@@ -74,6 +79,24 @@ int main(int argc, char const* argv[]) {
     hit_rate(io, cache_clock);
   }
 
+  std::cout << "sieve:" << std::endl;
+  for (auto size : sizes) {
+    fifo::sieve<> cache_sieve(size);
+    hit_rate(io, cache_sieve);
+  }
+
+  std::cout << "s3fifo:" << std::endl;
+  for (auto size : sizes) {
+    fifo::s3fifo<> cache_s3fifo(size);
+    hit_rate(io, cache_s3fifo);
+  }
+
+  std::cout << "adaptive:" << std::endl;
+  for (auto size : sizes) {
+    adaptive<lru, lfu, mru, clock_lru, lru_k<2>> cache_adaptive(size);
+    hit_rate(io, cache_adaptive);
+  }
+
   std::cout << "bin_lru:" << std::endl;
   using bin_pd = bin_dictionary::pd<bin_dictionary::lru<>>;
   for (auto size : sizes) {
@@ -88,5 +111,35 @@ int main(int argc, char const* argv[]) {
     hit_rate(io, cache_fe_lru);
   }
 
+  std::cout << "fe_clock:" << std::endl;
+  for (auto size : sizes) {
+    bin_cache<fano_elias::pd<fano_elias::evict_clock>, mul_shift> cache_fe_clock(size);
+    hit_rate(io, cache_fe_clock);
+  }
+
+  std::cout << "fe_lfu:" << std::endl;
+  for (auto size : sizes) {
+    bin_cache<fano_elias::pd<fano_elias::evict_lfu>, mul_shift> cache_fe_lfu(size);
+    hit_rate(io, cache_fe_lfu);
+  }
+
+  std::cout << "fe_age:" << std::endl;
+  for (auto size : sizes) {
+    bin_cache<fano_elias::pd<fano_elias::evict_age<>>, mul_shift> cache_fe_age(size);
+    hit_rate(io, cache_fe_age);
+  }
+
+  std::cout << "fe_rrip:" << std::endl;
+  for (auto size : sizes) {
+    bin_cache<fano_elias::pd<fano_elias::evict_age<2>>, mul_shift> cache_fe_rrip(size);
+    hit_rate(io, cache_fe_rrip);
+  }
+
+  std::cout << "felru:" << std::endl;
+  for (auto size : sizes) {
+    FELRU::cache<mul_shift> cache_felru(size);
+    hit_rate(io, cache_felru);
+  }
+
   return 0;
 }
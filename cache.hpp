@@ -1,3 +1,5 @@
+#pragma once
+
 #include <algorithm>
 #include <array>
 #include <cstddef>
@@ -6,6 +8,8 @@
 #include <set>
 #include <unordered_map>
 
+#include "stats.hpp"
+
 static const size_t max_size = 1 << 20;
 
 struct belady {
@@ -26,6 +30,7 @@ struct belady {
   using order = std::vector<size_t>;
   order chain;
   order::iterator head;
+  [[no_unique_address]] stats::counters counters;
 
   belady(std::vector<size_t> future, size_t size)
       : size(size), chain(order(future.size())), head(chain.begin()) {
@@ -50,9 +55,11 @@ struct belady {
     auto lookup = table.find(key);
     auto hit = lookup != table.end();
     auto order = *head++;
+    counters.add(hit ? stats::hits : stats::misses);
     if (hit)
       lookup->second.first = order;
     else {
+      counters.add(stats::inserts);
       while (table.size() >= size) evict();
       lookup = table.insert({key, {order, val}}).first;
     }
@@ -67,8 +74,16 @@ struct belady {
     heap.pop_back();
     if (auto victim = table.find(key);
         victim != table.end() &&
-        order == victim->second.first)
+        order == victim->second.first) {
       table.erase(victim);
+      counters.add(stats::evictions);
+    }
+  }
+
+  stats::snapshot stats() const {
+    auto s = counters.read();
+    s.length = table.size();
+    return s;
   }
 
   void describe() {
@@ -84,6 +99,7 @@ struct lru {
   using element = std::pair<order::iterator, void*>;
   std::unordered_map<size_t, element> table;
   order lru_;
+  [[no_unique_address]] stats::counters counters;
 
   lru(size_t size) : size(size) {
     table.reserve(size);
@@ -92,9 +108,11 @@ struct lru {
   auto set(size_t key, void* val) {
     auto lookup = table.find(key);
     auto hit = lookup != table.end();
+    counters.add(hit ? stats::hits : stats::misses);
     if (hit)
       move_to_front(lookup->second.first);
     else {
+      counters.add(stats::inserts);
       if (table.size() >= size) evict();
       lru_.push_front(key);
       table.insert({key, {lru_.begin(), val}});
@@ -106,12 +124,27 @@ struct lru {
     auto victim = lru_.back();
     lru_.pop_back();
     table.erase(victim);
+    counters.add(stats::evictions);
+  }
+
+  bool erase(size_t key) {
+    auto lookup = table.find(key);
+    if (lookup == table.end()) return false;
+    lru_.erase(lookup->second.first);
+    table.erase(lookup);
+    return true;
   }
 
   void move_to_front(order::iterator el) {
     lru_.splice(lru_.begin(), lru_, el);
   }
 
+  stats::snapshot stats() const {
+    auto s = counters.read();
+    s.length = lru_.size();
+    return s;
+  }
+
   void describe() {
     std::cout
         << "Cache Eviction Policy: LRU\n"
@@ -125,6 +158,7 @@ struct mru {
   using element = std::pair<order::iterator, void*>;
   std::unordered_map<size_t, element> table;
   order mru_;
+  [[no_unique_address]] stats::counters counters;
 
   mru(size_t size) : size(size) {
     table.reserve(size);
@@ -133,9 +167,11 @@ struct mru {
   auto set(size_t key, void* val) {
     auto lookup = table.find(key);
     auto hit = lookup != table.end();
+    counters.add(hit ? stats::hits : stats::misses);
     if (hit) {
       move_to_front(lookup->second.first);
     } else {
+      counters.add(stats::inserts);
       if (table.size() >= size) evict();
       mru_.push_front(key);
       table.insert({key, {mru_.begin(), val}});
@@ -147,12 +183,27 @@ struct mru {
     auto victim = mru_.front();
     mru_.pop_front();
     table.erase(victim);
+    counters.add(stats::evictions);
+  }
+
+  bool erase(size_t key) {
+    auto lookup = table.find(key);
+    if (lookup == table.end()) return false;
+    mru_.erase(lookup->second.first);
+    table.erase(lookup);
+    return true;
   }
 
   void move_to_front(order::iterator el) {
     mru_.splice(mru_.begin(), mru_, el);
   }
 
+  stats::snapshot stats() const {
+    auto s = counters.read();
+    s.length = mru_.size();
+    return s;
+  }
+
   void describe() {
     std::cout
         << "Cache Eviction Policy: MRU\n"
@@ -178,6 +229,7 @@ struct lru_k {
   std::unordered_map<size_t, element> table;
   order lru_;
   size_t t = 0;
+  [[no_unique_address]] stats::counters counters;
 
   lru_k(size_t size) : size(size) {
     table.reserve(size);
@@ -186,9 +238,11 @@ struct lru_k {
   auto set(size_t key, void* val) {
     auto lookup = table.find(key);
     auto hit = lookup != table.end();
+    counters.add(hit ? stats::hits : stats::misses);
     if (hit)
       move_to_front(lookup->second.first);
     else {
+      counters.add(stats::inserts);
       if (table.size() >= size) evict();
       auto it = lru_.insert({key, 0, {t}}).first;
       table.insert({key, {it, val}});
@@ -202,6 +256,15 @@ struct lru_k {
     auto victim = lru_.begin();  // smallest in the set
     table.erase(victim->key);
     lru_.erase(victim);
+    counters.add(stats::evictions);
+  }
+
+  bool erase(size_t key) {
+    auto lookup = table.find(key);
+    if (lookup == table.end()) return false;
+    lru_.erase(lookup->second.first);
+    table.erase(lookup);
+    return true;
   }
 
   void move_to_front(typename order::iterator& el) {
@@ -215,6 +278,14 @@ struct lru_k {
     el = lru_.insert(std::move(node)).position;
   }
 
+  // frequency counts the references in the window beyond the first
+  stats::snapshot stats() const {
+    auto s = counters.read();
+    s.length = lru_.size();
+    stats::frequency(s, lru_);
+    return s;
+  }
+
   void describe() {
     std::cout
         << "Cache Eviction Policy: LRU-" << K << '\n'
@@ -238,6 +309,7 @@ struct lfu {
   std::unordered_map<size_t, element> table;
   order lru_;
   size_t t = 0;
+  [[no_unique_address]] stats::counters counters;
 
   lfu(size_t size) : size(size) {
     table.reserve(size);
@@ -246,9 +318,11 @@ struct lfu {
   auto set(size_t key, void* val) {
     auto lookup = table.find(key);
     auto hit = lookup != table.end();
+    counters.add(hit ? stats::hits : stats::misses);
     if (hit)
       move_to_front(lookup->second.first);
     else {
+      counters.add(stats::inserts);
       if (table.size() >= size) evict();
       auto it = lru_.insert({key, 0, t}).first;
       table.insert({key, {it, val}});
@@ -261,6 +335,15 @@ struct lfu {
     auto victim = lru_.begin();  // smallest in the set
     table.erase(victim->key);
     lru_.erase(victim);
+    counters.add(stats::evictions);
+  }
+
+  bool erase(size_t key) {
+    auto lookup = table.find(key);
+    if (lookup == table.end()) return false;
+    lru_.erase(lookup->second.first);
+    table.erase(lookup);
+    return true;
   }
 
   void move_to_front(typename order::iterator& el) {
@@ -269,6 +352,13 @@ struct lfu {
     el = lru_.insert(std::move(node)).position;
   }
 
+  stats::snapshot stats() const {
+    auto s = counters.read();
+    s.length = lru_.size();
+    stats::frequency(s, lru_);
+    return s;
+  }
+
   void describe() {
     std::cout
         << "Cache Eviction Policy: LFU" << '\n'
@@ -286,6 +376,7 @@ struct clock_lru {
   using element = std::pair<order::iterator, void*>;
   std::unordered_map<size_t, element> table;
   order clock_;
+  [[no_unique_address]] stats::counters counters;
 
   clock_lru(size_t size) : size(size) {
     table.reserve(size);
@@ -295,9 +386,11 @@ struct clock_lru {
     auto lookup = table.find(key);
 
     auto hit = lookup != table.end();
+    counters.add(hit ? stats::hits : stats::misses);
     if (hit)
       lookup->second.first->bit = true;
     else {
+      counters.add(stats::inserts);
       while (table.size() >= size) evict();
       clock_.push_front({false, key});
       table.insert({key, {clock_.begin(), val}});
@@ -314,15 +407,30 @@ struct clock_lru {
         table.erase(victim->key);
         rotate_to_front(victim);
         clock_.erase(victim);
+        counters.add(stats::evictions);
         return;
       }
     }
   }
 
+  bool erase(size_t key) {
+    auto lookup = table.find(key);
+    if (lookup == table.end()) return false;
+    clock_.erase(lookup->second.first);
+    table.erase(lookup);
+    return true;
+  }
+
   void rotate_to_front(order::iterator el) {
     clock_.splice(clock_.begin(), clock_, el, clock_.end());
   }
 
+  stats::snapshot stats() const {
+    auto s = counters.read();
+    s.length = clock_.size();
+    return s;
+  }
+
   void describe() {
     std::cout
         << "Cache Eviction Policy: CLOCK\n"
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <algorithm>
 #include <array>
 #include <atomic>
@@ -10,6 +12,9 @@
 #include <iostream>
 #include <optional>
 
+#include "pd_array.hpp"
+#include "stats.hpp"
+
 struct spin_lock {
   std::atomic_flag flag = ATOMIC_FLAG_INIT;
   void lock() {
@@ -35,20 +40,26 @@ struct bin_cache {
 
   const size_t size = max_entries * 27;
   const size_t entries = max_entries;
-  std::vector<pd> pds;
+  pd_array<pd> pds;
   Hash hasher;
+  [[no_unique_address]] stats::counters counters;
 
   bin_cache(size_t size) : size(size), entries(size / 27), pds(entries) {}
+  bin_cache(pd_array<pd> pds)
+      : size(pds.size() * 27), entries(pds.size()), pds(std::move(pds)) {}
 
   auto set(size_t key, void*) {
     auto hash = hasher(key);
     auto b = hash % entries;
     uint16_t fp = static_cast<uint16_t>(hash / entries);
     auto& pd_ = pds[b];
-    auto lookup = pd_.find(fp, key);
-    auto hit = lookup.has_value();
-    if (!hit) pd_.insert(fp, key);
-    return hit;
+    return stats::counted_set(counters, pd_, fp, key);
+  }
+
+  stats::snapshot stats() {
+    auto s = counters.read();
+    stats::occupancy(s, pds);
+    return s;
   }
 
   void describe() {
@@ -61,10 +72,12 @@ struct bin_cache {
 template <class pd, typename Hash = std::identity>
 struct par_bin_cache {
   const size_t entries = max_entries;
-  std::vector<pd> pds;
+  pd_array<pd> pds;
   Hash hasher;
+  [[no_unique_address]] stats::counters counters;
 
   par_bin_cache(size_t size) : entries(size / 27), pds(entries) {}
+  par_bin_cache(pd_array<pd> pds) : entries(pds.size()), pds(std::move(pds)) {}
   
   auto set(size_t key, void*) {
     auto hash = hasher(key);
@@ -73,14 +86,16 @@ struct par_bin_cache {
     auto& pd_ = pds[b];
 
     pd_.lock();
-
-    auto lookup = pd_.find(fp, key);
-    auto hit = lookup.has_value();
-    if (!hit) pd_.insert(fp, key);
-
+    auto hit = stats::counted_set(counters, pd_, fp, key);
     pd_.unlock();
     return hit;
   }
+
+  stats::snapshot stats() {
+    auto s = counters.read();
+    stats::occupancy(s, pds);
+    return s;
+  }
 };
 
 namespace bin_dictionary {
@@ -186,13 +201,141 @@ struct element {
   
 using cache = element[27];
 
+// Eviction policies. An ordered policy keeps recency by moving a hit to
+// the front of its quotient and picks the victim bit of the header. The
+// others keep a side word with a bit or two per ptr_table slot, which a
+// hit only updates in place, and pick the victim slot among all the
+// entries of the pd:
+//   hit(index), insert(index), drop(index) on the ptr_table slot index
+//   victim(q) returning the ptr_table slot index to evict
+
+// The least recently used element of the first non-empty quotient after
+// q, wrapping around to q itself last
 struct evict_q {
+  static const bool ordered = true;
+
   uint64_t operator()(uint64_t header, uint16_t q) {
     uint64_t pivot = bit_index(header, q);
     uint64_t h =  (pivot - 1) | header;
     if (h == 0x7ff'ffff'ffff'ffffUL) h = ~(pivot - 1) | header;
     return ~h & (h + 1);
   }
+
+  void hit(uint16_t) {}
+  void insert(uint16_t) {}
+  void drop(uint16_t) {}
+};
+
+// Live slots and a hand for the side word policies. Ties are broken by
+// the hand, so among equal candidates the oldest slot to be filled
+// after the last eviction goes first.
+struct slot_policy {
+  static const bool ordered = false;
+
+  uint32_t live = 0;
+  uint8_t hand = 0;
+
+  void insert(uint16_t index) { live |= 1U << index; }
+  void drop(uint16_t index) { live &= ~(1U << index); }
+
+  // the first index of mask at or after the hand, wrapping around
+  uint16_t next(uint32_t mask) {
+    auto after = mask & (~0U << hand);
+    uint16_t index = std::countr_zero(after ? after : mask);
+    hand = index + 1;
+    return index;
+  }
+};
+
+// reference : Corbato, A Paging Experiment with the Multics System (1968),
+// CLOCK. A hit sets the reference bit of its slot, the hand
+// evicts the first slot without one and clears the bits it passes.
+struct evict_clock : slot_policy {
+  uint32_t ref = 0;
+
+  void hit(uint16_t index) { ref |= 1U << index; }
+
+  void insert(uint16_t index) {
+    slot_policy::insert(index);
+    ref &= ~(1U << index);
+  }
+
+  uint16_t victim(uint16_t) {
+    auto cold = live & ~ref;
+    if (!cold) {
+      ref = 0;
+      cold = live;
+    }
+    auto from = hand;
+    auto index = next(cold);
+    uint32_t passed_from = ~0U << from, passed_to = (1U << index) - 1;
+    ref &= index >= from ? ~(passed_from & passed_to) : ~(passed_from | passed_to);
+    return index;
+  }
+};
+
+// reference : https://arxiv.org/abs/1512.00727
+// (Einziger et al., TinyLFU). Bucket local LFU with a saturating 2 bit
+// frequency per slot, stored as two bit planes so that aging is a few
+// word operations. New entries start at 0 and go first, and when every
+// entry has been hit the frequencies are halved, TinyLFU's reset.
+struct evict_lfu : slot_policy {
+  uint32_t lo = 0, hi = 0;
+
+  void hit(uint16_t index) {
+    uint32_t bit = 1U << index;
+    auto carry = lo & bit;
+    lo = (lo ^ bit) | (hi & carry);
+    hi |= carry;
+  }
+
+  void insert(uint16_t index) {
+    slot_policy::insert(index);
+    lo &= ~(1U << index);
+    hi &= ~(1U << index);
+  }
+
+  uint16_t victim(uint16_t) {
+    uint32_t rare;
+    while (!(rare = live & ~lo & ~hi)) {
+      lo = hi;
+      hi = 0;
+    }
+    return next(rare);
+  }
+};
+
+// reference : https://doi.org/10.1145/1815961.1815971
+// (Jaleel et al., RRIP). Approximate LRU over the whole pd with a 2 bit
+// age per slot, again as two bit planes. A hit resets the age to 0, new
+// entries start at Insert, and the victim is the first slot of age 3,
+// every age being incremented, saturating, until one is. Insert = 2 is
+// SRRIP, which keeps a scan from flushing the entries that were hit.
+template <unsigned Insert = 0>
+struct evict_age : slot_policy {
+  uint32_t lo = 0, hi = 0;
+
+  void hit(uint16_t index) {
+    lo &= ~(1U << index);
+    hi &= ~(1U << index);
+  }
+
+  void insert(uint16_t index) {
+    slot_policy::insert(index);
+    uint32_t bit = 1U << index;
+    lo = (lo & ~bit) | (Insert & 1 ? bit : 0);
+    hi = (hi & ~bit) | (Insert & 2 ? bit : 0);
+  }
+
+  uint16_t victim(uint16_t) {
+    uint32_t old;
+    while (!(old = live & lo & hi)) {
+      auto carry = lo;
+      lo = ~lo | hi;
+      hi |= carry;
+    }
+    return next(old);
+  }
 };
 
 
@@ -209,22 +352,73 @@ struct pd {
      14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27};
   
   Evict policy;
-  void evict(uint16_t q) {
-    auto victim = policy(header, q) - 1;
+  // returns the evicted key
+  size_t evict(uint16_t q) {
+    if constexpr (!Evict::ordered) {
+      auto index = policy.victim(q);
+      auto key = ptr_table[index];
+      erase(position(index));
+      return key;
+    } else {
+      auto victim = policy(header, q) - 1;
+
+      auto prefix = ~victim & header;
+      prefix = (-prefix & prefix) - 1;
+      auto slot = std::popcount(~header & (prefix >> 1));
+
+      header = (victim & header) | (~victim & (header >> 1));
+      auto key = ptr_table[bins[slot].index];
+      release(slot);
+      return key;
+    }
+  }
 
-    auto prefix = ~victim & header;
-    prefix = (-prefix & prefix) - 1;
-    auto slot = std::popcount(~header & (prefix >> 1));
+  // The slot of bins holding ptr_table slot index. Slots past the
+  // occupancy may hold stale copies, hence the first match.
+  uint16_t position(uint16_t index) const {
+#if __AVX2__
+    auto low = _mm256_set1_epi16(31);
+    auto want = _mm256_set1_epi16(index);
+    auto head = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bins));
+    auto tail = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bins + 11));
+    uint64_t lo = _mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(head, low), want));
+    uint64_t hi = _mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(tail, low), want));
+    return std::countr_zero((lo & 0xffff'ffffUL) | (hi << 22)) / 2;
+#else
+    uint16_t slot = 0;
+    while (bins[slot].index != index) ++slot;
+    return slot;
+#endif
+  }
 
-    header = (victim & header) | (~victim & (header >> 1));
-    
+  // A hit on slot of the quotient starting at first: moved to the front
+  // for ordered policies, otherwise only its side word state is updated
+  void touch(element* first, element* slot) {
+    if constexpr (Evict::ordered)
+      std::rotate(first, slot, slot + 1);
+    else
+      policy.hit(slot->index);
+  }
+
+  // drops bins[slot]
+  void erase(uint16_t slot) {
+    auto mask = bit_index(~header, slot) - 1;
+    header = (header & mask) | ((header >> 1) & ~mask);
+    release(slot);
+  }
+
+  // drops bins[slot] once the header no longer counts it
+  void release(uint16_t slot) {
     auto prev = bins[slot].index;
     std::memmove(bins + slot, bins + slot + 1, (27 - slot - 1) * sizeof(element));
     ptr_table[prev] = freelist;
     freelist = prev;
+    policy.drop(prev);
   }
 
-  std::optional<size_t> find(uint16_t fp, size_t key) {
+  // A fingerprint that matches another key is counted in counters
+  std::optional<size_t> find(uint16_t fp, size_t key,
+                             stats::counters* counters = nullptr) {
     uint16_t q = fp & 31U;
     uint16_t r = fp >> 5;
 
@@ -235,16 +429,20 @@ struct pd {
     if (slot == bins + end)
       return {};
     else if(auto found = ptr_table[slot->index]; found == key) {
-      std::rotate(bins + begin, slot, slot + 1);
+      touch(bins + begin, slot);
       return found;
     }
-    else
+    else {
+      if (counters) counters->add(stats::false_matches);
       return {};
+    }
   }
 
-  void insert(uint16_t fp, size_t key) {
+  // Returns the key evicted to make room, if any
+  std::optional<size_t> insert(uint16_t fp, size_t key) {
     uint16_t q = fp & 31U;
-    if (freelist >= 27) evict(q);
+    std::optional<size_t> evicted;
+    if (freelist >= 27) evicted = evict(q);
     uint16_t r = fp >> 5;
 
     uint64_t mask = q ? ((bit_index(header, q - 1) << 1) - 1) : 0;
@@ -257,6 +455,30 @@ struct pd {
     freelist = ptr_table[freelist];
     bins[slot] = {ptr_slot, r};
     ptr_table[ptr_slot] = (uint64_t)key;
+    policy.insert(ptr_slot);
+    return evicted;
+  }
+
+  size_t occupancy() const { return std::bit_width(header) - 32; }
+
+  // Calls fn(fp, key) for every element, least recently used first
+  // within each quotient, so that inserting them in this order into an
+  // empty pd rebuilds the same recency order. Side word policies start
+  // over in the rebuilt pd.
+  template <typename F>
+  void for_each(F fn) const {
+    for (auto slot = occupancy(); slot-- > 0;) {
+      uint64_t bit = bit_index(~header, slot);
+      uint16_t q = std::popcount(header & (bit - 1));
+      fn(static_cast<uint16_t>((bins[slot].fp << 5) | q), ptr_table[bins[slot].index]);
+    }
+  }
+
+  void clear() {
+    header = 0xffff'ffffUL;
+    freelist = 0;
+    for (uint16_t i = 0; i < 27; ++i) ptr_table[i] = i + 1;
+    policy = Evict();
   }
 };
 
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cinttypes>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "PD.hpp"
+#include "stats.hpp"
+#include "workload.hpp"
+
+// FIFO based policies. A hit only sets a bit or bumps a two bit counter
+// of its entry, so with the concurrent variants (Lock = FELRU::spin_lock)
+// hits are lock free and only misses take the lock, under which the
+// queues are updated and victims are chosen.
+//
+// Entries live in a flat pool, the queues are arrays of pool ids and the
+// index maps keys to ids.
+
+namespace fifo {
+
+static const uint32_t none = ~0U;
+
+// Open addressing with linear probing and backward shift deletion. One
+// writer, holding the engine's lock, and any number of readers without
+// it. A reader racing with a deletion can miss a key that is present,
+// which only sends it to the locked path that looks again, or get the id
+// of a key shifted into its slot, so readers check the id against the
+// pool (see lookup). Key ~0 is reserved.
+struct probe_index {
+  static const uint64_t empty = ~0UL;
+
+  struct slot {
+    std::atomic<uint64_t> key{empty};
+    std::atomic<uint32_t> id{none};
+  };
+
+  const size_t mask;
+  std::unique_ptr<slot[]> slots;
+
+  // at most half full
+  probe_index(size_t size)
+      : mask(std::bit_ceil(2 * size + 1) - 1), slots(new slot[mask + 1]) {}
+
+  size_t home(uint64_t key) const { return workload::mix(key) & mask; }
+
+  uint32_t find(uint64_t key) const {
+    for (auto i = home(key);; i = (i + 1) & mask) {
+      auto k = slots[i].key.load(std::memory_order_acquire);
+      if (k == key) return slots[i].id.load(std::memory_order_relaxed);
+      if (k == empty) return none;
+    }
+  }
+
+  // key must not be present
+  void insert(uint64_t key, uint32_t id) {
+    auto i = home(key);
+    while (slots[i].key.load(std::memory_order_relaxed) != empty) i = (i + 1) & mask;
+    slots[i].id.store(id, std::memory_order_relaxed);
+    slots[i].key.store(key, std::memory_order_release);
+  }
+
+  void erase(uint64_t key) {
+    auto i = home(key);
+    for (;; i = (i + 1) & mask) {
+      auto k = slots[i].key.load(std::memory_order_relaxed);
+      if (k == key) break;
+      if (k == empty) return;
+    }
+    // move back every later key of the run that may live at i, copying
+    // before clearing so readers never find a moved key missing
+    for (auto j = (i + 1) & mask;; j = (j + 1) & mask) {
+      auto k = slots[j].key.load(std::memory_order_relaxed);
+      if (k == empty) break;
+      auto h = home(k);
+      if (((j - h) & mask) < ((j - i) & mask)) continue;
+      slots[i].id.store(slots[j].id.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      slots[i].key.store(k, std::memory_order_release);
+      i = j;
+    }
+    slots[i].key.store(empty, std::memory_order_release);
+  }
+};
+
+// Bounded FIFO of ids, oldest at tail
+template <typename T = uint32_t>
+struct ring {
+  const size_t mask;
+  std::vector<T> buf;
+  size_t head = 0, tail = 0;
+
+  ring(size_t size) : mask(std::bit_ceil(size + 1) - 1), buf(mask + 1) {}
+
+  size_t size() const { return head - tail; }
+  bool empty() const { return head == tail; }
+  void push(T id) { buf[head++ & mask] = id; }
+  T pop() { return buf[tail++ & mask]; }
+};
+
+// Pool entries, the mark is the visited bit or the frequency
+struct entry {
+  std::atomic<uint64_t> key{0};
+  std::atomic<uint8_t> mark{0};
+};
+
+// Lock free lookup. The index may hand out an id that no longer, or
+// never did, belong to key, so the entry's key is checked: a hit is only
+// reported for an entry that held key. Ids are reused once freed, so an
+// entry can still be evicted and refilled between the check and the mark
+// update, which then lands on the new entry; that costs it at most one
+// extra pass of the hand and is tolerated as it is for any other racy
+// hint.
+inline entry* lookup(const probe_index& index, entry* pool, uint64_t key) {
+  auto id = index.find(key);
+  if (id == none) return nullptr;
+  auto& e = pool[id];
+  return e.key.load(std::memory_order_relaxed) == key ? &e : nullptr;
+}
+
+// reference : https://www.usenix.org/conference/nsdi24/presentation/zhang-yazhuo
+// (Zhang et al., SIEVE). New keys are appended to a queue, a hit sets
+// the visited bit of its entry. The hand walks from old to new, clearing
+// visited bits, and evicts the first unvisited entry, which leaves a hole
+// in place: entries the hand passes keep their position. Holes are
+// squeezed out when the queue array, twice the cache size, fills up.
+template <typename Lock = FELRU::no_lock>
+struct sieve {
+  static const uint32_t hole = none;
+
+  const size_t size;
+  probe_index index;
+  std::unique_ptr<entry[]> pool;
+  std::vector<uint32_t> free;
+  std::vector<uint32_t> queue;
+  size_t hand = 0;
+  size_t count = 0;
+  Lock lock;
+  [[no_unique_address]] stats::counters counters;
+
+  sieve(size_t size) : size(size), index(size), pool(new entry[size]) {
+    free.reserve(size);
+    for (auto id = static_cast<uint32_t>(size); id-- > 0;) free.push_back(id);
+    queue.reserve(2 * size);
+  }
+
+  bool set(size_t key, void*) {
+    if (hit(key)) return true;
+    std::lock_guard guard(lock);
+    if constexpr (!std::is_same_v<Lock, FELRU::no_lock>)
+      if (hit(key)) return true;
+    counters.add(stats::misses);
+    counters.add(stats::inserts);
+    if (count >= size) evict();
+    if (queue.size() == 2 * size) compact();
+    auto id = free.back();
+    free.pop_back();
+    pool[id].key.store(key, std::memory_order_relaxed);
+    pool[id].mark.store(0, std::memory_order_relaxed);
+    queue.push_back(id);
+    index.insert(key, id);
+    ++count;
+    return false;
+  }
+
+  bool hit(size_t key) {
+    auto e = lookup(index, pool.get(), key);
+    if (!e) return false;
+    if (!e->mark.load(std::memory_order_relaxed))
+      e->mark.store(1, std::memory_order_relaxed);
+    counters.add(stats::hits);
+    return true;
+  }
+
+  void evict() {
+    for (;; ++hand) {
+      if (hand == queue.size()) hand = 0;
+      auto id = queue[hand];
+      if (id == hole) continue;
+      if (pool[id].mark.load(std::memory_order_relaxed)) {
+        pool[id].mark.store(0, std::memory_order_relaxed);
+        continue;
+      }
+      queue[hand++] = hole;
+      index.erase(pool[id].key.load(std::memory_order_relaxed));
+      free.push_back(id);
+      --count;
+      counters.add(stats::evictions);
+      return;
+    }
+  }
+
+  void compact() {
+    size_t live = 0, new_hand = 0;
+    for (size_t i = 0; i < queue.size(); ++i) {
+      if (i == hand) new_hand = live;
+      if (queue[i] != hole) queue[live++] = queue[i];
+    }
+    hand = hand == queue.size() ? live : new_hand;
+    queue.resize(live);
+  }
+
+  stats::snapshot stats() {
+    std::lock_guard guard(lock);
+    auto s = counters.read();
+    s.length = count;
+    return s;
+  }
+
+  void describe() {
+    std::cout
+        << "Cache Eviction Policy: SIEVE\n"
+        << "Hash table size: " << size << std::endl;
+  }
+};
+
+// reference : https://dl.acm.org/doi/10.1145/3600006.3613147
+// (Yang et al., S3-FIFO). A small FIFO takes 10% of the entries and a
+// main FIFO the rest, a hit bumps a frequency capped at 3. Entries leave
+// the small queue for the main one if they were hit more than once,
+// otherwise their key goes to a ghost FIFO (as large as the main queue)
+// and a miss on a ghost key inserts straight into the main queue. The
+// main queue reinserts entries with a non-zero frequency, decremented.
+template <typename Lock = FELRU::no_lock>
+struct s3fifo {
+  const size_t size;
+  const size_t small_size;
+  probe_index index;
+  std::unique_ptr<entry[]> pool;
+  std::vector<uint32_t> free;
+  ring<> small, main;
+  const size_t ghost_size;
+  ring<uint64_t> ghost;
+  probe_index ghost_index;  // key -> ghost position, writer only
+  Lock lock;
+  [[no_unique_address]] stats::counters counters;
+
+  s3fifo(size_t size)
+      : size(size), small_size(std::max<size_t>(size / 10, 1)),
+        index(size), pool(new entry[size]), small(size), main(size),
+        ghost_size(size - small_size), ghost(ghost_size), ghost_index(ghost_size + 1) {
+    free.reserve(size);
+    for (auto id = static_cast<uint32_t>(size); id-- > 0;) free.push_back(id);
+  }
+
+  bool set(size_t key, void*) {
+    if (hit(key)) return true;
+    std::lock_guard guard(lock);
+    if constexpr (!std::is_same_v<Lock, FELRU::no_lock>)
+      if (hit(key)) return true;
+    counters.add(stats::misses);
+    counters.add(stats::inserts);
+    while (small.size() + main.size() >= size) evict();
+
+    auto id = free.back();
+    free.pop_back();
+    pool[id].key.store(key, std::memory_order_relaxed);
+    pool[id].mark.store(0, std::memory_order_relaxed);
+    if (ghost_index.find(key) != none) {
+      ghost_index.erase(key);
+      main.push(id);
+    } else {
+      small.push(id);
+    }
+    index.insert(key, id);
+    return false;
+  }
+
+  bool hit(size_t key) {
+    auto e = lookup(index, pool.get(), key);
+    if (!e) return false;
+    auto freq = e->mark.load(std::memory_order_relaxed);
+    if (freq < 3) e->mark.store(freq + 1, std::memory_order_relaxed);
+    counters.add(stats::hits);
+    return true;
+  }
+
+  void evict() {
+    if (small.size() >= small_size || main.empty())
+      evict_small();
+    else
+      evict_main();
+  }
+
+  void evict_small() {
+    while (!small.empty()) {
+      auto id = small.pop();
+      if (pool[id].mark.load(std::memory_order_relaxed) > 1) {
+        pool[id].mark.store(0, std::memory_order_relaxed);
+        main.push(id);
+        if (main.size() > size - small_size) return evict_main();
+        continue;
+      }
+      remember(pool[id].key.load(std::memory_order_relaxed));
+      drop(id);
+      return;
+    }
+  }
+
+  void evict_main() {
+    while (!main.empty()) {
+      auto id = main.pop();
+      auto freq = pool[id].mark.load(std::memory_order_relaxed);
+      if (freq > 0) {
+        pool[id].mark.store(freq - 1, std::memory_order_relaxed);
+        main.push(id);
+        continue;
+      }
+      drop(id);
+      return;
+    }
+  }
+
+  void drop(uint32_t id) {
+    index.erase(pool[id].key.load(std::memory_order_relaxed));
+    free.push_back(id);
+    counters.add(stats::evictions);
+  }
+
+  // the ghost index holds the position of the latest copy of each key
+  static uint32_t position(size_t seq) { return seq & 0x7fff'ffffU; }
+
+  void remember(uint64_t key) {
+    if (ghost.size() == ghost_size) {
+      auto seq = position(ghost.tail);
+      auto old = ghost.pop();
+      if (ghost_index.find(old) == seq) ghost_index.erase(old);
+    }
+    if (ghost_index.find(key) != none) ghost_index.erase(key);
+    ghost_index.insert(key, position(ghost.head));
+    ghost.push(key);
+  }
+
+  stats::snapshot stats() {
+    std::lock_guard guard(lock);
+    auto s = counters.read();
+    s.length = small.size() + main.size();
+    return s;
+  }
+
+  void describe() {
+    std::cout
+        << "Cache Eviction Policy: S3-FIFO\n"
+        << "Hash table size: " << size << std::endl;
+  }
+};
+
+using par_sieve = sieve<FELRU::spin_lock>;
+using par_s3fifo = s3fifo<FELRU::spin_lock>;
+
+};  // namespace fifo
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "felru.hpp"
+#include "flash.hpp"
+#include "io.hpp"
+
+using clock_ = std::chrono::steady_clock;
+using pd = fano_elias::pd<>;
+
+static const unsigned depth = 64;
+
+void report(std::vector<double>& latency) {
+  auto percentile = [&latency](double p) {
+    auto nth = latency.begin() + static_cast<size_t>(p * (latency.size() - 1));
+    std::nth_element(latency.begin(), nth, latency.end());
+    return *nth;
+  };
+  std::cout << "  p50_us: " << percentile(0.5) << '\n'
+            << "  p99_us: " << percentile(0.99) << std::endl;
+}
+
+void dram_only(std::vector<size_t>& io, size_t size) {
+  bin_cache<pd, mul_shift> cache(size);
+  std::vector<double> latency(io.size());
+  size_t hits = 0;
+  for (size_t i = 0; i < io.size(); ++i) {
+    auto start = clock_::now();
+    hits += cache.set(io[i], nullptr);
+    latency[i] = std::chrono::duration<double, std::micro>(clock_::now() - start).count();
+  }
+  std::cout << "dram_only:\n"
+            << "  hit_rate: " << (double)hits / (double)io.size() << std::endl;
+  report(latency);
+}
+
+// Replays the trace in windows of depth accesses, all flash reads of a
+// window are in flight together. Latency of an access runs from its set()
+// to its completion. Read amplification is bytes read from flash per byte
+// of flash hits, write amplification bytes written per byte evicted from
+// DRAM, below 1 as evicted keys that still have a live record are not
+// written again.
+template <class IO>
+void hybrid(const char* name, std::vector<size_t>& io, size_t size, std::string path,
+            size_t flash_bytes, flash::reclaim policy) {
+  flash::hybrid_cache<pd, mul_shift, IO> cache(size, path, flash_bytes, policy, 1024, depth);
+  if (!cache.ok()) {
+    std::cerr << name << ": no flash tier" << std::endl;
+    return;
+  }
+
+  std::vector<double> latency(io.size());
+  std::vector<clock_::time_point> start(depth);
+  size_t dram_hits = 0;
+  for (size_t w = 0; w < io.size(); w += depth) {
+    auto n = std::min<size_t>(depth, io.size() - w);
+    for (size_t j = 0; j < n; ++j) {
+      start[j] = clock_::now();
+      auto result = cache.set(io[w + j], j);
+      if (result == cache.pending) continue;
+      dram_hits += result == cache.dram_hit;
+      latency[w + j] = std::chrono::duration<double, std::micro>(clock_::now() - start[j]).count();
+    }
+    cache.complete([&](uint64_t j, bool) {
+      latency[w + j] = std::chrono::duration<double, std::micro>(clock_::now() - start[j]).count();
+    });
+  }
+
+  auto& log = cache.log;
+  auto logical = (double)cache.demoted * (double)log.item_size;
+  auto useful = (double)cache.flash_hits * (double)log.item_size;
+  std::cout << name << ":\n"
+            << "  hit_rate: " << (double)(dram_hits + cache.flash_hits) / (double)io.size() << '\n'
+            << "  dram_hit_rate: " << (double)dram_hits / (double)io.size() << '\n'
+            << "  flash_hit_rate: " << (double)cache.flash_hits / (double)io.size() << '\n'
+            << "  false_reads: " << cache.false_reads << '\n'
+            << "  read_amplification: " << (useful > 0 ? cache.bytes_read / useful : 0) << '\n'
+            << "  write_amplification: " << (logical > 0 ? log.bytes_written / logical : 0) << '\n'
+            << "  records_reclaimed: " << log.records_reclaimed << std::endl;
+  if constexpr (stats::enabled) cache.stats().dump(std::cout, "  ");
+  report(latency);
+}
+
+// flash.out <trace or spec> [flash file or device] [flash MiB] [dram entries]
+// The flash target is scratch: a file that must not exist yet, created
+// and deleted again, or a block device whose contents are overwritten.
+int main(int argc, char const* argv[]) {
+  if (argc < 2) return 1;
+
+  auto io = load_trace(argv[1]);
+  if (io.empty()) return 1;
+  std::string path = argc > 2 ? argv[2] : "flash.dat";
+  size_t flash_bytes = (argc > 3 ? std::stoul(argv[3]) : 512) << 20;
+  size_t size = argc > 4 ? std::stoul(argv[4]) : 1 << 16;
+
+  dram_only(io, size);
+  hybrid<flash::uring>("fifo_uring", io, size, path, flash_bytes, flash::fifo);
+  hybrid<flash::uring>("lru_uring", io, size, path, flash_bytes, flash::lru);
+  hybrid<flash::pread_pool>("fifo_pread", io, size, path, flash_bytes, flash::fifo);
+}
@@ -0,0 +1,517 @@
+#pragma once
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PD.hpp"
+#include "felru.hpp"
+#include "pd_array.hpp"
+#include "stats.hpp"
+#include "workload.hpp"
+
+// A second cache tier on a local file or block device. Keys evicted from
+// the pds of the DRAM tier are appended to a log of fixed size regions,
+// and a DRAM miss whose key the flash index knows reads the record back
+// to confirm it.
+
+namespace flash {
+
+static const size_t block = 4096;
+
+inline size_t round_up(size_t x, size_t to) { return (x + to - 1) / to * to; }
+
+struct free_deleter {
+  void operator()(void* p) const { std::free(p); }
+};
+using buffer = std::unique_ptr<char[], free_deleter>;
+
+inline buffer aligned(size_t len) {
+  return buffer(static_cast<char*>(std::aligned_alloc(block, round_up(len, block))));
+}
+
+// reference : https://kernel.dk/io_uring.pdf
+// Reads through io_uring, with the raw system calls so that liburing is
+// not needed. read() queues, wait() submits and hands every completion
+// to fn(tag, result) until none are outstanding.
+struct uring {
+  int fd = -1;
+  unsigned entries = 0;
+  unsigned queued = 0;
+  unsigned inflight = 0;
+
+  void* sq_ring = MAP_FAILED;
+  void* cq_ring = MAP_FAILED;
+  size_t sq_len = 0, cq_len = 0, sqes_len = 0;
+  unsigned *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+  io_uring_cqe* cqes;
+
+  uring(unsigned depth) {
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    fd = static_cast<int>(::syscall(__NR_io_uring_setup, depth, &p));
+    if (fd < 0) return;
+    entries = p.sq_entries;
+
+    sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+    sq_ring = ::mmap(nullptr, sq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cq_ring = ::mmap(nullptr, cq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+      ::close(fd);
+      fd = -1;
+      return;
+    }
+
+    auto sq = static_cast<char*>(sq_ring);
+    sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    auto cq = static_cast<char*>(cq_ring);
+    cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+  }
+  uring(const uring&) = delete;
+
+  ~uring() {
+    if (sq_ring != MAP_FAILED) ::munmap(sq_ring, sq_len);
+    if (cq_ring != MAP_FAILED) ::munmap(cq_ring, cq_len);
+    if (sqes != MAP_FAILED) ::munmap(sqes, sqes_len);
+    if (fd >= 0) ::close(fd);
+  }
+
+  bool ok() const { return fd >= 0; }
+  static const char* name() { return "io_uring"; }
+
+  // at most entries reads may be outstanding
+  void read(int file, void* buf, size_t len, uint64_t off, uint64_t tag) {
+    auto tail = *sq_tail;
+    auto index = tail & *sq_mask;
+    auto& sqe = sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = file;
+    sqe.addr = reinterpret_cast<uint64_t>(buf);
+    sqe.len = static_cast<uint32_t>(len);
+    sqe.off = off;
+    sqe.user_data = tag;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++queued;
+  }
+
+  template <typename Fn>
+  void wait(Fn fn) {
+    while (queued + inflight > 0) {
+      auto ret = ::syscall(__NR_io_uring_enter, fd, queued, 1, IORING_ENTER_GETEVENTS,
+                           nullptr, 0);
+      if (ret < 0) {
+        if (errno == EINTR) continue;
+        std::perror("io_uring_enter");
+        std::exit(1);
+      }
+      queued -= static_cast<unsigned>(ret);
+      inflight += static_cast<unsigned>(ret);
+
+      auto head = *cq_head;
+      auto tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+      for (; head != tail; ++head, --inflight) {
+        auto& cqe = cqes[head & *cq_mask];
+        fn(cqe.user_data, static_cast<int64_t>(cqe.res));
+      }
+      __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+  }
+};
+
+// Fallback with the same interface as uring: a pool of threads doing
+// blocking preads.
+struct pread_pool {
+  struct request {
+    int file;
+    void* buf;
+    size_t len;
+    uint64_t off;
+    uint64_t tag;
+  };
+
+  std::mutex m;
+  std::condition_variable cv, done_cv;
+  std::deque<request> pending;
+  std::vector<std::pair<uint64_t, int64_t>> done;
+  size_t outstanding = 0;
+  bool stop = false;
+  std::vector<std::thread> workers;
+
+  pread_pool(unsigned num) {
+    for (unsigned i = 0; i < num; ++i) workers.emplace_back([this] { run(); });
+  }
+
+  ~pread_pool() {
+    {
+      std::lock_guard guard(m);
+      stop = true;
+    }
+    cv.notify_all();
+    for (auto& th : workers) th.join();
+  }
+
+  bool ok() const { return true; }
+  static const char* name() { return "pread"; }
+
+  void read(int file, void* buf, size_t len, uint64_t off, uint64_t tag) {
+    {
+      std::lock_guard guard(m);
+      pending.push_back({file, buf, len, off, tag});
+      ++outstanding;
+    }
+    cv.notify_one();
+  }
+
+  template <typename Fn>
+  void wait(Fn fn) {
+    std::vector<std::pair<uint64_t, int64_t>> reaped;
+    std::unique_lock guard(m);
+    while (outstanding > 0) {
+      done_cv.wait(guard, [this] { return !done.empty(); });
+      reaped.swap(done);
+      outstanding -= reaped.size();
+      guard.unlock();
+      for (auto [tag, res] : reaped) fn(tag, res);
+      reaped.clear();
+      guard.lock();
+    }
+  }
+
+  void run() {
+    for (;;) {
+      request r;
+      {
+        std::unique_lock guard(m);
+        cv.wait(guard, [this] { return stop || !pending.empty(); });
+        if (pending.empty()) return;
+        r = pending.front();
+        pending.pop_front();
+      }
+      auto res = ::pread(r.file, r.buf, r.len, static_cast<off_t>(r.off));
+      {
+        std::lock_guard guard(m);
+        done.emplace_back(r.tag, res < 0 ? -errno : res);
+      }
+      done_cv.notify_one();
+    }
+  }
+};
+
+enum reclaim { fifo, lru };
+
+// The file is split into regions of region_size bytes, each holding
+// region_size / item_size records that start with their key. Records are
+// collected in a DRAM buffer and written with one sequential write per
+// region. When all regions are used, the region filled first (fifo) or
+// read least recently (lru) is reused.
+//
+// A location packs region, generation and slot. Reusing a region bumps
+// its generation, which invalidates every location pointing into it
+// without touching the index.
+struct log {
+  static const unsigned slot_bits = 16;
+  static const unsigned gen_bits = 24;
+
+  const size_t item_size;
+  const size_t region_size;
+  const size_t regions;
+  const reclaim policy;
+  int fd = -1;
+  bool created = false;
+  std::string path;
+
+  std::vector<uint32_t> gen;
+  std::vector<uint64_t> stamp;
+  uint64_t clock = 0;
+  size_t active = 0;
+  size_t used = 0;  // regions written at least once
+  size_t fill = 0;
+  buffer buf;
+
+  size_t bytes_written = 0;
+  size_t records_reclaimed = 0;  // records in reused regions
+
+  log(std::string path, size_t bytes, size_t item_size = 1024,
+      size_t region_size = 1 << 20, reclaim policy = fifo)
+      : item_size(item_size), region_size(region_size),
+        regions(std::max<size_t>(bytes / region_size, 2)), policy(policy),
+        path(path), gen(regions, 1), stamp(regions, 0), buf(aligned(region_size)) {
+    // a new file, removed again on destruction, or an existing block
+    // device, overwritten. Existing files are left alone.
+    struct stat st;
+    int flags = O_RDWR;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISBLK(st.st_mode)) {
+      flags |= O_CREAT | O_EXCL;
+      created = true;
+    }
+    fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+    if (fd < 0 && errno == EINVAL) fd = ::open(path.c_str(), flags, 0644);
+    if (fd < 0) {
+      created = false;
+      std::perror(path.c_str());
+      return;
+    }
+    if (created && ::ftruncate(fd, static_cast<off_t>(regions * region_size)) != 0)
+      std::perror(path.c_str());
+    std::memset(buf.get(), 0, region_size);
+  }
+  log(const log&) = delete;
+
+  ~log() {
+    if (fd < 0) return;
+    ::close(fd);
+    if (created) ::unlink(path.c_str());
+  }
+
+  bool ok() const { return fd >= 0; }
+  size_t per_region() const { return region_size / item_size; }
+
+  static uint64_t region_of(uint64_t loc) { return loc >> (slot_bits + gen_bits); }
+  static uint64_t slot_of(uint64_t loc) { return loc & ((1UL << slot_bits) - 1); }
+  static uint32_t gen_of(uint64_t loc) {
+    return static_cast<uint32_t>((loc >> slot_bits) & ((1UL << gen_bits) - 1));
+  }
+
+  bool live(uint64_t loc) const {
+    return gen_of(loc) == (gen[region_of(loc)] & ((1U << gen_bits) - 1));
+  }
+
+  // record still in the write buffer
+  const char* buffered(uint64_t loc) const {
+    return region_of(loc) == active ? buf.get() + slot_of(loc) * item_size : nullptr;
+  }
+
+  uint64_t offset(uint64_t loc) const {
+    return region_of(loc) * region_size + slot_of(loc) * item_size;
+  }
+
+  void touch(uint64_t loc) {
+    if (policy == lru) stamp[region_of(loc)] = ++clock;
+  }
+
+  uint64_t append(size_t key) {
+    if (fill == per_region()) flush();
+    uint64_t loc = (static_cast<uint64_t>(active) << (slot_bits + gen_bits)) |
+                   (static_cast<uint64_t>(gen[active] & ((1U << gen_bits) - 1)) << slot_bits) |
+                   fill;
+    std::memcpy(buf.get() + fill * item_size, &key, sizeof(key));
+    ++fill;
+    return loc;
+  }
+
+  void flush() {
+    auto ret = ::pwrite(fd, buf.get(), region_size, static_cast<off_t>(active * region_size));
+    if (ret != static_cast<ssize_t>(region_size)) std::perror("flash write");
+    bytes_written += region_size;
+    stamp[active] = ++clock;
+    used = std::max(used, active + 1);
+
+    if (used < regions) {
+      active = used;
+    } else {
+      active = std::min_element(stamp.begin(), stamp.end()) - stamp.begin();
+      records_reclaimed += per_region();
+      ++gen[active];
+      if ((gen[active] & ((1U << gen_bits) - 1)) == 0) ++gen[active];
+    }
+    fill = 0;
+    std::memset(buf.get(), 0, region_size);
+  }
+};
+
+// fano_elias bins in DRAM over a log. The flash index is an array of
+// FELRU::PD keyed by a second hash of the key, with the location of the
+// record as pointer, so it costs about two bytes of fingerprint and a
+// location per item. A fingerprint match is only a candidate: the record
+// is read and its key compared, and reads of the wrong record count
+// toward read amplification. Index entries for reused regions are not
+// removed, they fail live() and age out of their pd.
+//
+// set() serves the DRAM tier and, on a miss, inserts the key there at
+// once. If the index has a candidate, a read is queued with the caller's
+// tag and complete() later reports whether it was a flash hit. At most
+// depth set() calls may happen between two complete() calls. The
+// counters take hits of both tiers, and inserts and evictions of the
+// DRAM tier, where every eviction is a demotion.
+template <class pd, typename Hash = mul_shift, class IO = uring>
+struct hybrid_cache {
+  using index_pd = FELRU::PD<FELRU::ptr, FELRU::no_lock>;
+
+  enum result { miss, dram_hit, flash_hit, pending };
+
+  struct probe {
+    size_t key;
+    uint64_t loc;
+    uint64_t tag;
+    size_t skip;  // offset of the record in its read buffer
+    buffer buf;
+  };
+
+  const size_t entries;
+  pd_array<pd> pds;
+  Hash hasher;
+
+  flash::log log;
+  const size_t index_entries;
+  pd_array<index_pd> index;
+  IO io;
+  std::vector<probe> reads;
+  std::vector<size_t> free_reads;
+
+  size_t demoted = 0;
+  size_t flash_hits = 0;
+  size_t false_reads = 0;
+  size_t bytes_read = 0;
+  [[no_unique_address]] stats::counters counters;
+
+  hybrid_cache(size_t size, std::string path, size_t flash_bytes,
+               reclaim policy = fifo, size_t item_size = 1024, unsigned depth = 64)
+      : entries(size / 27), pds(entries),
+        log(path, flash_bytes, item_size, 1 << 20, policy),
+        // about 80% full once every region holds live records
+        index_entries(log.regions * log.per_region() * 5 / 4 / 27 + 1),
+        index(index_entries), io(depth), reads(depth) {
+    for (size_t i = depth; i-- > 0;) {
+      reads[i].buf = aligned(round_up(item_size, block) + block);
+      free_reads.push_back(i);
+    }
+  }
+
+  bool ok() const { return log.ok() && io.ok(); }
+
+  auto index_slot(size_t key) {
+    auto hash = workload::mix(key);
+    return std::pair{&index[hash % index_entries],
+                     static_cast<uint16_t>(hash / index_entries)};
+  }
+
+  // location of a live candidate record for key, or 0
+  uint64_t locate(size_t key) {
+    auto [pd_, fp] = index_slot(key);
+    return pd_->find(fp, [this](uint64_t loc) { return log.live(loc); }).getRaw();
+  }
+
+  // Keys still in the write buffer are not written again. A candidate
+  // on flash may be another key with the same fingerprint, and telling
+  // would take a read, so the key is written anyway and the older copy
+  // ages out like any stale location.
+  void demote(size_t key) {
+    ++demoted;
+    if (auto loc = locate(key))
+      if (auto record = log.buffered(loc); record && std::memcmp(record, &key, sizeof(key)) == 0)
+        return;
+    auto loc = log.append(key);
+    auto [pd_, fp] = index_slot(key);
+    pd_->insert(fp, FELRU::ptr(loc));
+  }
+
+  result set(size_t key, uint64_t tag) {
+    auto hash = hasher(key);
+    auto b = hash % entries;
+    uint16_t fp = static_cast<uint16_t>(hash / entries);
+    auto& pd_ = pds[b];
+    if (pd_.find(fp, key, &counters).has_value()) {
+      counters.add(stats::hits);
+      return dram_hit;
+    }
+    counters.add(stats::inserts);
+    if (auto evicted = pd_.insert(fp, key)) {
+      counters.add(stats::evictions);
+      demote(*evicted);
+    }
+
+    auto loc = locate(key);
+    if (!loc) {
+      counters.add(stats::misses);
+      return miss;
+    }
+    if (auto record = log.buffered(loc)) {
+      bool hit = std::memcmp(record, &key, sizeof(key)) == 0;
+      counters.add(hit ? stats::hits : stats::misses);
+      if (!hit) return miss;
+      ++flash_hits;
+      return flash_hit;
+    }
+    auto i = free_reads.back();
+    free_reads.pop_back();
+    auto off = log.offset(loc);
+    auto start = off / block * block;
+    auto len = round_up(off + log.item_size, block) - start;
+    reads[i].key = key;
+    reads[i].loc = loc;
+    reads[i].tag = tag;
+    reads[i].skip = off - start;
+    io.read(log.fd, reads[i].buf.get(), len, start, i);
+    bytes_read += len;
+    return pending;
+  }
+
+  // Waits for every queued read, calling fn(tag, hit) for each
+  template <typename Fn>
+  void complete(Fn fn) {
+    io.wait([this, &fn](uint64_t i, int64_t res) {
+      auto& r = reads[i];
+      bool hit = res > 0 && log.live(r.loc) &&
+                 std::memcmp(r.buf.get() + r.skip, &r.key, sizeof(r.key)) == 0;
+      if (hit) {
+        ++flash_hits;
+        log.touch(r.loc);
+      } else {
+        ++false_reads;
+      }
+      counters.add(hit ? stats::hits : stats::misses);
+      free_reads.push_back(i);
+      fn(r.tag, hit);
+    });
+  }
+
+  stats::snapshot stats() {
+    auto s = counters.read();
+    stats::occupancy(s, pds);
+    return s;
+  }
+
+  void describe() {
+    std::cout
+        << "Cache Eviction Policy: FELRU + flash log ("
+        << (log.policy == fifo ? "FIFO" : "LRU") << " regions, " << IO::name() << ")\n"
+        << "Cache size: " << entries * 27 << " + "
+        << log.regions * log.per_region() << std::endl;
+  }
+};
+
+};  // namespace flash
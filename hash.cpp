@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "felru.hpp"
+#include "hash.hpp"
+#include "io.hpp"
+
+static volatile uint64_t sink;
+
+template <typename Hash>
+double ns_per_hash(std::vector<size_t>& io) {
+  Hash hasher;
+  uint64_t sum = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (auto key : io) sum += hasher(key);
+  auto stop = std::chrono::high_resolution_clock::now();
+  sink = sum;
+  return std::chrono::duration<double, std::nano>(stop - start).count() / io.size();
+}
+
+// Replays the trace through a bin_cache with Hash and reports
+//   fp_false_match_rate: lookups that find an element of another key with
+//     the same fingerprint in their pd (each one is a miss in bin_cache)
+//   occupancy_mean / occupancy_variance: of the pds at the end
+//   dispersion: variance / mean of the distinct keys per bucket, about 1
+//     for a random hash, larger when keys cluster
+template <typename Hash>
+void quality(const char* name, std::vector<size_t>& io,
+             const std::vector<size_t>& keys, size_t size) {
+  using pd = fano_elias::pd<>;
+  bin_cache<pd, Hash> cache(size);
+  Hash hasher;
+
+  size_t hits = 0, false_matches = 0;
+  for (auto key : io) {
+    auto hash = hasher(key);
+    uint16_t fp = static_cast<uint16_t>(hash / cache.entries);
+    bool collides = false;
+    cache.pds[hash % cache.entries].for_each([&](uint16_t other_fp, size_t other) {
+      collides |= other_fp == fp && other != key;
+    });
+    false_matches += collides;
+    hits += cache.set(key, nullptr);
+  }
+
+  auto moments = [](auto count, size_t n) {
+    double sum = 0, sq = 0;
+    for (size_t i = 0; i < n; ++i) {
+      double c = count(i);
+      sum += c;
+      sq += c * c;
+    }
+    double mean = sum / n;
+    return std::pair{mean, sq / n - mean * mean};
+  };
+  auto [occupancy, occupancy_var] =
+      moments([&](size_t b) { return cache.pds[b].occupancy(); }, cache.entries);
+
+  std::vector<uint32_t> load(cache.entries, 0);
+  for (auto key : keys) ++load[hasher(key) % cache.entries];
+  auto [load_mean, load_var] = moments([&](size_t b) { return load[b]; }, cache.entries);
+
+  std::cout << name << ":\n"
+            << "  ns_per_hash: " << ns_per_hash<Hash>(io) << '\n'
+            << "  hit_rate: " << (double)hits / (double)io.size() << '\n'
+            << "  fp_false_match_rate: " << (double)false_matches / (double)io.size() << '\n'
+            << "  occupancy_mean: " << occupancy << '\n'
+            << "  occupancy_variance: " << occupancy_var << '\n'
+            << "  dispersion: " << load_var / load_mean << std::endl;
+}
+
+// hash.out <trace or spec> [cache size]
+int main(int argc, char const* argv[]) {
+  if (argc < 2) return 1;
+
+  auto io = load_trace(argv[1]);
+  if (io.empty()) return 1;
+  size_t size = argc > 2 ? std::stoul(argv[2]) : 1 << 17;
+
+  auto keys = io;
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  quality<std::identity>("identity", io, keys, size);
+  quality<mul_shift>("mul_shift", io, keys, size);
+  quality<hash::crc32c>("crc32c", io, keys, size);
+  quality<hash::xxh3>("xxh3", io, keys, size);
+  quality<hash::tabulation>("tabulation", io, keys, size);
+  quality<hash::fmix64>("fmix64", io, keys, size);
+  quality<hash::splitmix>("splitmix", io, keys, size);
+}
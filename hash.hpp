@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cinttypes>
+#include <immintrin.h>
+
+#include "workload.hpp"
+
+// Hashes for the Hash parameter of the bin caches, beside mul_shift and
+// std::identity. Bin caches use hash % entries as bucket and the next 16
+// bits of hash / entries as fingerprint, so every bit of the result must
+// depend on every bit of the key.
+
+namespace hash {
+
+// reference : https://doi.org/10.1109/26.231911
+// (Castagnoli, CRC-32C). One crc32 instruction per 32 bits of hash. A
+// CRC is affine in its seed, so the high half is the CRC of the key times
+// an odd constant rather than of the key with another seed, which would
+// only differ from the low half by a constant.
+struct crc32c {
+  static const uint64_t odd = 0x9e37'79b9'7f4a'7c15UL;
+
+  uint64_t operator()(uint64_t x) const {
+#if __SSE4_2__
+    uint64_t lo = _mm_crc32_u64(0x243f'6a88UL, x);
+    uint64_t hi = _mm_crc32_u64(0x85a3'08d3UL, x * odd);
+#else
+    uint64_t lo = soft(0x243f'6a88U, x), hi = soft(0x85a3'08d3U, x * odd);
+#endif
+    return (hi << 32) | lo;
+  }
+
+  static uint32_t soft(uint32_t crc, uint64_t x) {
+    for (int i = 0; i < 64; ++i, x >>= 1)
+      crc = (crc >> 1) ^ (0x82f6'3b78U & -((crc ^ static_cast<uint32_t>(x)) & 1U));
+    return crc;
+  }
+};
+
+// reference : https://github.com/Cyan4973/xxHash/blob/dev/xxhash.h
+// XXH3_len_4to8_64b with the default secret and seed 0: the key is xored
+// with a secret and goes through the rrmxmx finalizer.
+struct xxh3 {
+  static const uint64_t bitflip = 0x1cad'21f7'2c81'017cUL ^ 0xdb97'9083'e96d'd4deUL;
+  static const uint64_t prime = 0x9fb2'1c65'1e98'df25UL;
+
+  uint64_t operator()(uint64_t x) const {
+    uint64_t h = std::rotl(x, 32) ^ bitflip;
+    h ^= std::rotl(h, 49) ^ std::rotl(h, 24);
+    h *= prime;
+    h ^= (h >> 35) + 8;
+    h *= prime;
+    return h ^ (h >> 28);
+  }
+};
+
+// reference : https://doi.org/10.1145/2220357.2220361
+// (Patrascu and Thorup, simple tabulation). 3-independent, eight lookups
+// into 16 KiB of random tables.
+struct tabulation {
+  using tables = std::array<std::array<uint64_t, 256>, 8>;
+
+  static const tables& table() {
+    static const tables t = [] {
+      tables t;
+      workload::rng r(0x7ab);
+      for (auto& row : t)
+        for (auto& word : row) word = r();
+      return t;
+    }();
+    return t;
+  }
+
+  const tables& t = table();
+
+  uint64_t operator()(uint64_t x) const {
+    uint64_t h = 0;
+    for (size_t i = 0; i < 8; ++i, x >>= 8) h ^= t[i][x & 0xff];
+    return h;
+  }
+};
+
+// reference : https://github.com/aappleby/smhasher/blob/master/src/MurmurHash3.cpp
+// fmix64, the finalizer of MurmurHash3, as a full avalanche mix.
+struct fmix64 {
+  uint64_t operator()(uint64_t x) const {
+    x ^= x >> 33;
+    x *= 0xff51'afd7'ed55'8ccdUL;
+    x ^= x >> 33;
+    x *= 0xc4ce'b9fe'1a85'ec53UL;
+    return x ^ (x >> 33);
+  }
+};
+
+// the splitmix64 finalizer of workload.hpp
+struct splitmix {
+  uint64_t operator()(uint64_t x) const { return workload::mix(x); }
+};
+
+};  // namespace hash
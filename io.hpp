@@ -1,4 +1,7 @@
+#pragma once
+
 #include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <functional>
 #include <iostream>
@@ -7,6 +10,8 @@
 #include <utility>
 #include <vector>
 
+#include "workload.hpp"
+
 std::vector<size_t> load_zipf(std::string fname) {
   std::ifstream f(fname);
 
@@ -20,12 +25,13 @@ std::vector<size_t> load_zipf(std::string fname) {
 }
 
 // See http://www.wikibench.eu/?page_id=60 for Wiki traces
+// If times is given, it receives the timestamp (seconds) of every request.
 
-std::vector<size_t> load_wiki(std::string fname) {
+std::vector<size_t> load_wiki(std::string fname, std::vector<double>* times = nullptr) {
   std::ifstream f(fname);
 
   std::hash<std::string> key;
-  std::map<size_t, size_t> timeline;
+  std::map<size_t, std::pair<double, size_t>> timeline;
   std::string link, flag;
   double time;
   for (size_t counter = 0UL;
@@ -33,13 +39,16 @@ std::vector<size_t> load_wiki(std::string fname) {
        (f >> time) &&
        (f >> link) &&
        (f >> flag);) {
-    timeline.insert({counter, key(link)});
+    timeline.insert({counter, {time, key(link)}});
   }
 
   std::vector<size_t> io;
   io.reserve(timeline.size());
-  for (auto [_, key] : timeline)
-    io.push_back(key);
+  if (times) times->reserve(timeline.size());
+  for (auto [_, request] : timeline) {
+    io.push_back(request.second);
+    if (times) times->push_back(request.first);
+  }
   return io;
 }
 
@@ -63,3 +72,51 @@ std::vector<size_t> load_arc(std::string fname) {
   }
   return io;
 }
+
+// A part of a joined trace name names a generator or an existing file
+bool is_trace(std::string_view part) {
+  std::error_code ec;
+  return workload::is_spec(part) || std::filesystem::exists(part, ec);
+}
+
+// Position of the first '+' that splits name into a trace and a joinable
+// rest, npos if there is none. Spec values (n=1e+6) and file names may
+// contain '+' themselves, a '+' that leaves an invalid part on either
+// side is kept.
+size_t join_point(std::string_view name) {
+  for (auto plus = name.find('+'); plus != std::string_view::npos;
+       plus = name.find('+', plus + 1)) {
+    auto rest = name.substr(plus + 1);
+    if (is_trace(name.substr(0, plus)) &&
+        (is_trace(rest) || join_point(rest) != std::string_view::npos))
+      return plus;
+  }
+  return std::string_view::npos;
+}
+
+// Generates the trace in-process if fname is a workload spec (see
+// workload.hpp), otherwise picks the loader from the file name. Traces
+// joined by '+' are replayed one after the other (see join_point).
+
+// Only single wiki traces carry timestamps, times is left empty for the
+// others.
+
+std::vector<size_t> load_trace(std::string fname, std::vector<double>* times = nullptr) {
+  if (auto plus = join_point(fname); plus != std::string::npos) {
+    auto io = load_trace(fname.substr(0, plus));
+    auto rest = load_trace(fname.substr(plus + 1));
+    if (io.empty() || rest.empty()) return {};
+    io.insert(io.end(), rest.begin(), rest.end());
+    return io;
+  }
+  if (workload::is_spec(fname)) {
+    auto spec = workload::parse(fname);
+    return spec ? workload::generate(*spec) : std::vector<size_t>{};
+  }
+  if (fname.ends_with(".lis"))
+    return load_arc(fname);
+  else if (fname.ends_with(".yaml"))
+    return load_zipf(fname);
+  else
+    return load_wiki(fname, times);
+}
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cache.hpp"
+#include "felru.hpp"
+#include "io.hpp"
+#include "loading.hpp"
+
+// Replays the trace through a loading_cache with num client threads, which
+// take every num-th access so that they miss on hot keys together.
+template <typename Cache>
+void replay(std::vector<size_t>& io, loading::latency lat, size_t max_batch,
+            bool coalesce, const size_t num) {
+  loading::backing_store store(lat);
+  loading::loading_cache<Cache> cache(1 << 17, coalesce);
+  loading::batch_loader loader(store, max_batch);  // joined before cache goes
+
+  std::vector<std::vector<double>> latencies(num);
+  std::atomic<size_t> hits = 0;
+
+  auto fn = [&](const size_t p) {
+    auto& local = latencies[p];
+    local.reserve(io.size() / num + 1);
+    size_t local_hit = 0;
+    for (auto i = p; i < io.size(); i += num) {
+      auto start = loading::clock::now();
+      loading::source from;
+      auto val = cache.get_or_load(io[i], loader, &from);
+      local_hit += from == loading::cached;
+      val.wait();
+      auto stop = loading::clock::now();
+      local.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+    }
+    hits += local_hit;
+  };
+
+  auto start = loading::clock::now();
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < num; ++p) threads.emplace_back(fn, p);
+  for (auto& th : threads) th.join();
+  auto stop = loading::clock::now();
+  auto secs = std::chrono::duration<double>(stop - start).count();
+
+  std::vector<double> all;
+  for (auto& local : latencies) all.insert(all.end(), local.begin(), local.end());
+  auto percentile = [&all](double p) {
+    auto nth = all.begin() + static_cast<size_t>(p * (all.size() - 1));
+    std::nth_element(all.begin(), nth, all.end());
+    return *nth;
+  };
+
+  std::cout << "  -\n"
+            << "    coalesce: " << coalesce << '\n'
+            << "    max_batch: " << max_batch << '\n'
+            << "    hit_rate: " << (double)hits / (double)io.size() << '\n'
+            << "    coalesced: " << cache.coalesced << '\n'
+            << "    backend_requests: " << store.requests << '\n'
+            << "    backend_keys: " << store.keys << '\n'
+            << "    backend_qps: " << (double)store.requests / secs << '\n'
+            << "    throughput: " << (double)io.size() / secs / 1e6 << '\n'
+            << "    p50_us: " << percentile(0.5) << '\n'
+            << "    p99_us: " << percentile(0.99) << std::endl;
+  if constexpr (stats::enabled) cache.stats().dump(std::cout);
+}
+
+template <typename Cache>
+void compare(std::vector<size_t>& io, loading::latency lat, const size_t num) {
+  for (size_t max_batch : {1, 32})
+    for (bool coalesce : {false, true})
+      replay<Cache>(io, lat, max_batch, coalesce, num);
+}
+
+// loading.out <trace or spec> [latency, e.g. exp:200] [accesses]
+int main(int argc, char const* argv[]) {
+  if (argc < 2) return 1;
+
+  auto io = load_trace(argv[1]);
+  if (io.empty()) return 1;
+  auto lat = loading::latency::parse(argc > 2 ? argv[2] : "exp:200");
+  size_t len = argc > 3 ? std::stoul(argv[3]) : 1UL << 19;
+  io.resize(std::min(io.size(), len));
+
+  static const size_t N = 16;
+
+  std::cout << "fe_lru:" << std::endl;
+  using pd = fano_elias::par_pd<>;
+  compare<par_bin_cache<pd, mul_shift>>(io, lat, N);
+
+  std::cout << "lru:" << std::endl;
+  compare<loading::synchronized<lru>>(io, lat, N);
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "stats.hpp"
+#include "workload.hpp"
+
+// Read-through caching over a simulated backing store. A miss in the
+// underlying engine goes to a loader, and concurrent misses on a key that
+// is still being loaded can wait on the same load (single-flight) instead
+// of going to the backend again.
+
+namespace loading {
+
+using clock = std::chrono::steady_clock;
+
+// Service time of one backend request: a sampled base latency, plus a
+// fixed cost per key in the request.
+struct latency {
+  enum kind { constant, uniform, exponential, lognormal };
+  kind dist = exponential;
+  double mean_us = 200;
+  double per_key_us = 1;
+
+  // "<dist>:<mean us>", dist one of const, uniform, exp, lognormal
+  static latency parse(std::string arg) {
+    latency lat;
+    auto colon = arg.find(':');
+    auto name = arg.substr(0, colon);
+    if (name == "const") lat.dist = constant;
+    else if (name == "uniform") lat.dist = uniform;
+    else if (name == "lognormal") lat.dist = lognormal;
+    if (colon != std::string::npos)
+      lat.mean_us = std::strtod(arg.c_str() + colon + 1, nullptr);
+    return lat;
+  }
+
+  double sample(workload::rng& r, size_t keys) const {
+    double u = r.uniform();
+    double base = mean_us;
+    switch (dist) {
+      case constant: break;
+      case uniform: base = 2 * mean_us * u; break;
+      case exponential: base = -mean_us * std::log1p(-u); break;
+      case lognormal: {
+        // sigma = 1, scaled to keep the mean
+        double v = r.uniform();
+        double z = std::sqrt(-2 * std::log1p(-u)) * std::cos(2 * M_PI * v);
+        base = mean_us * std::exp(z - 0.5);
+        break;
+      }
+    }
+    return base + per_key_us * static_cast<double>(keys);
+  }
+};
+
+// Stand-in for the real store. Every request blocks the calling thread for
+// a sampled latency, the value of a key is the key itself.
+struct backing_store {
+  latency lat;
+  std::atomic<size_t> requests{0};
+  std::atomic<size_t> keys{0};
+
+  backing_store(latency lat) : lat(lat) {}
+
+  std::vector<void*> load(const std::vector<size_t>& batch) {
+    thread_local workload::rng r(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    requests.fetch_add(1, std::memory_order_relaxed);
+    keys.fetch_add(batch.size(), std::memory_order_relaxed);
+    auto us = lat.sample(r, batch.size());
+    std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(us));
+
+    std::vector<void*> vals;
+    vals.reserve(batch.size());
+    for (auto key : batch) vals.push_back(reinterpret_cast<void*>(key));
+    return vals;
+  }
+};
+
+using done = std::function<void(void*)>;
+
+// Asynchronous loader: loader(key, done) queues the key and returns at
+// once, a pool of workers sends queued keys to the store in batches of up
+// to max_batch, waiting at most window for a batch to fill up. A max_batch
+// of 1 gives one request per key.
+struct batch_loader {
+  backing_store& store;
+  const size_t max_batch;
+  const clock::duration window;
+
+  std::mutex m;
+  std::condition_variable cv;
+  std::vector<std::pair<size_t, done>> pending;
+  bool stop = false;
+  std::vector<std::thread> workers;
+
+  batch_loader(backing_store& store, size_t max_batch = 32,
+               clock::duration window = std::chrono::microseconds(50),
+               size_t num = 16)
+      : store(store), max_batch(max_batch), window(window) {
+    for (size_t i = 0; i < num; ++i) workers.emplace_back([this] { run(); });
+  }
+
+  ~batch_loader() {
+    {
+      std::lock_guard guard(m);
+      stop = true;
+    }
+    cv.notify_all();
+    for (auto& th : workers) th.join();
+  }
+
+  void operator()(size_t key, done fn) {
+    {
+      std::lock_guard guard(m);
+      pending.emplace_back(key, std::move(fn));
+    }
+    cv.notify_one();
+  }
+
+  void run() {
+    std::vector<std::pair<size_t, done>> batch;
+    std::vector<size_t> keys;
+    for (;;) {
+      {
+        std::unique_lock guard(m);
+        cv.wait(guard, [this] { return stop || !pending.empty(); });
+        if (pending.empty()) return;
+        if (pending.size() < max_batch)
+          cv.wait_for(guard, window, [this] { return stop || pending.size() >= max_batch; });
+        auto n = std::min(max_batch, pending.size());
+        // oldest first, so that no key waits behind later ones
+        batch.assign(std::make_move_iterator(pending.begin()),
+                     std::make_move_iterator(pending.begin() + n));
+        pending.erase(pending.begin(), pending.begin() + n);
+      }
+      keys.clear();
+      for (auto& [key, _] : batch) keys.push_back(key);
+      auto vals = store.load(keys);
+      for (size_t i = 0; i < batch.size(); ++i) batch[i].second(vals[i]);
+      batch.clear();
+    }
+  }
+};
+
+// Serializes an engine that is not thread safe (cache.hpp)
+template <class Cache>
+struct synchronized {
+  Cache cache;
+  std::mutex m;
+
+  synchronized(size_t size) : cache(size) {}
+
+  auto set(size_t key, void* val) {
+    std::lock_guard guard(m);
+    return cache.set(key, val);
+  }
+
+  stats::snapshot stats() {
+    std::lock_guard guard(m);
+    return cache.stats();
+  }
+};
+
+// Where get_or_load() got the value from: the engine, a load already in
+// flight for the key, or a load of its own
+enum source { cached, shared_load, own_load };
+
+// Read-through layer over any engine with set(). A key counts as present
+// in the engine from the moment its miss is recorded, but lookups of it
+// are routed to the pending load until that load completes. With coalesce
+// they wait for it, without it every such lookup loads the key again.
+template <class Cache>
+struct loading_cache {
+  struct shard {
+    std::mutex m;
+    std::unordered_map<size_t, std::shared_future<void*>> inflight;
+  };
+
+  Cache cache;
+  const bool coalesce;
+  std::array<shard, 64> shards;
+  std::atomic<size_t> coalesced{0};
+  [[no_unique_address]] stats::counters counters;  // lookups of pending loads
+
+  loading_cache(size_t size, bool coalesce = true) : cache(size), coalesce(coalesce) {}
+
+  template <typename Loader>
+  std::shared_future<void*> get_or_load(size_t key, Loader& loader,
+                                        source* from = nullptr) {
+    auto& shard_ = shards[workload::mix(key) % shards.size()];
+    source ignored;
+    auto& from_ = from ? *from : ignored;
+
+    std::unique_lock guard(shard_.m);
+    if (auto pending = shard_.inflight.find(key); pending != shard_.inflight.end()) {
+      counters.add(stats::misses);
+      if (coalesce) {
+        coalesced.fetch_add(1, std::memory_order_relaxed);
+        from_ = shared_load;
+        return pending->second;
+      }
+      guard.unlock();
+      from_ = own_load;
+      auto promise = std::make_shared<std::promise<void*>>();
+      auto result = promise->get_future().share();
+      loader(key, [promise](void* val) { promise->set_value(val); });
+      return result;
+    }
+    if (cache.set(key, nullptr)) {
+      guard.unlock();
+      from_ = cached;
+      std::promise<void*> ready;
+      ready.set_value(reinterpret_cast<void*>(key));
+      return ready.get_future().share();
+    }
+
+    auto promise = std::make_shared<std::promise<void*>>();
+    auto result = promise->get_future().share();
+    shard_.inflight.emplace(key, result);
+    guard.unlock();
+    from_ = own_load;
+
+    // the waiters may destroy the cache once they are woken, so the
+    // shard is left before the promise is fulfilled
+    loader(key, [promise, &shard_, key](void* val) {
+      {
+        std::lock_guard guard(shard_.m);
+        shard_.inflight.erase(key);
+      }
+      promise->set_value(val);
+    });
+    return result;
+  }
+
+  // The engine counts the lookups that reach it, those routed to a
+  // pending load are added as misses
+  stats::snapshot stats() {
+    auto s = cache.stats();
+    s.counters[stats::misses] += counters.read()[stats::misses];
+    return s;
+  }
+};
+
+};  // namespace loading
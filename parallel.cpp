@@ -1,22 +1,33 @@
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cmath>
 #include <cstddef>
 #include <numeric>
+#include <string>
 #include <thread>
 #include <vector>
 
+#include "PD.hpp"
 #include "felru.hpp"
+#include "fifo.hpp"
 #include "io.hpp"
+#include "resize.hpp"
 
 template <typename Cache>
-void throughput(std::vector<size_t>& io, Cache& cache, const size_t num) {
+double throughput(std::vector<size_t>& io, Cache& cache, const size_t num) {
   std::vector<size_t> hits(num, 0);
 
   using iter = std::vector<size_t>::iterator;
   auto fn = [&hits, &cache](const size_t p, const iter begin, const iter end) {
     size_t local_hit = 0;
-    for (auto it = begin; it != end; ++it)
+    // with counters compiled in, thread 0 dumps them to stderr every second
+    stats::periodic dump(std::chrono::seconds(1));
+    for (auto it = begin; it != end; ++it) {
       local_hit += cache.set(*it, nullptr);
+      if constexpr (stats::enabled)
+        if (p == 0) dump([&cache] { cache.stats().dump(std::cerr); });
+    }
     hits[p] += local_hit;
   };
 
@@ -43,22 +54,241 @@ void throughput(std::vector<size_t>& io, Cache& cache, const size_t num) {
   std::cout << "    throughput: " << throughput << std::endl;
   std::cout << "    hit_rate: " << hit_rate << std::endl;
   std::cout << "    hits: " << hit << std::endl;
+  if constexpr (stats::enabled) cache.stats().dump(std::cout);
+  return throughput;
+}
+
+// Open loop replay: request i is due at arrivals[i] (ns from the start)
+// whether or not earlier requests are done, so a stall shows up in the
+// latency of every request queued behind it instead of slowing down the
+// load (coordinated omission). Requests are split across threads by hash
+// of the key, or round robin, and each thread serves its share in
+// arrival order. Latency runs from the due time to completion.
+template <typename Cache>
+void open_loop(std::vector<size_t>& io, const std::vector<double>& arrivals,
+               Cache& cache, const size_t num, bool by_hash) {
+  using clock = std::chrono::steady_clock;
+  const size_t n = arrivals.size();
+  std::vector<std::vector<size_t>> share(num);
+  for (size_t i = 0; i < n; ++i)
+    share[by_hash ? workload::mix(io[i]) % num : i % num].push_back(i);
+
+  std::vector<double> latency(n);
+  std::vector<size_t> hits(num, 0);
+  std::vector<clock::time_point> finish(num);
+  auto start = clock::now() + std::chrono::milliseconds(1);
+
+  // waiting threads only give up the core if there are more than cores
+  bool yield = num > std::thread::hardware_concurrency();
+  auto fn = [&](const size_t p) {
+    size_t local_hit = 0;
+    auto now = clock::now();
+    for (auto i : share[p]) {
+      auto due = start + std::chrono::nanoseconds(static_cast<int64_t>(arrivals[i]));
+      // the completion time of the last request saves a clock read when
+      // running behind
+      while (now < due) {
+        if (yield) std::this_thread::yield();
+        now = clock::now();
+      }
+      local_hit += cache.set(io[i], nullptr);
+      now = clock::now();
+      latency[i] = std::chrono::duration<double, std::nano>(now - due).count();
+    }
+    hits[p] = local_hit;
+    finish[p] = now;
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num; ++i) threads.emplace_back(fn, i);
+  for (auto& th : threads) th.join();
+
+  auto stop = *std::max_element(finish.begin(), finish.end());
+  auto us = std::chrono::duration<double, std::micro>(stop - start).count();
+  auto percentile = [&latency](size_t per_mille) {
+    auto nth = latency.begin() + (latency.size() - 1) * per_mille / 1000;
+    std::nth_element(latency.begin(), nth, latency.end());
+    return *nth;
+  };
+  size_t hit = std::accumulate(hits.begin(), hits.end(), 0UL);
+  std::cout << "      offered: " << n / (arrivals.back() / 1e3) << '\n'
+            << "      throughput: " << n / us << '\n'
+            << "      hit_rate: " << (double)hit / (double)n << '\n'
+            << "      p50_ns: " << percentile(500) << '\n'
+            << "      p99_ns: " << percentile(990) << '\n'
+            << "      p999_ns: " << percentile(999) << '\n'
+            << "      max_ns: " << *std::max_element(latency.begin(), latency.end())
+            << std::endl;
+}
+
+// Due times (ns) of requests arriving at qps per second on average, either
+// a Poisson process or the trace timestamps rescaled to that mean rate.
+std::vector<double> schedule(size_t n, double qps, const std::vector<double>& times) {
+  std::vector<double> arrivals(n);
+  if (times.empty()) {
+    workload::rng r(n);
+    double t = 0;
+    for (auto& at : arrivals) at = t += -std::log1p(-r.uniform()) / qps * 1e9;
+  } else {
+    auto scale = (n - 1) / qps * 1e9 / std::max(times[n - 1] - times[0], 1e-9);
+    for (size_t i = 0; i < n; ++i) arrivals[i] = (times[i] - times[0]) * scale;
+  }
+  return arrivals;
+}
+
+// Latency against offered load, as a fraction of the closed loop peak of
+// the same engine with num threads. Each point warms a new cache with the
+// first half of the trace, then replays at most a second worth of the
+// requests that follow, so that all points start equally warm.
+template <typename Cache, typename Make>
+void load_curve(std::vector<size_t>& io, const std::vector<double>& times,
+                const size_t num, bool by_hash, Make make) {
+  std::cout << "  peak:" << std::endl;
+  double peak;
+  {
+    Cache cache = make();
+    peak = throughput(io, cache, num) * 1e6;
+  }
+  auto warm = io.size() / 2;
+  std::vector<size_t> rest(io.begin() + warm, io.end());
+  std::vector<double> rest_times;
+  if (!times.empty()) rest_times.assign(times.begin() + warm, times.end());
+
+  std::cout << "  curve:" << std::endl;
+  for (double load : {0.1, 0.3, 0.5, 0.6, 0.7, 0.8, 0.9, 1.0, 1.1}) {
+    auto qps = load * peak;
+    auto n = std::min(rest.size(), std::max<size_t>(qps, 2));
+    std::cout << "    -\n"
+              << "      load: " << load << std::endl;
+    Cache cache = make();
+    for (size_t i = 0; i < warm; ++i) cache.set(io[i], nullptr);
+    open_loop(rest, schedule(n, qps, rest_times), cache, num, by_hash);
+  }
+}
+
+// Replays the trace like throughput(), and once a quarter of it is done
+// resizes the cache to `to` entries. Every 8th set() is timed, samples are
+// split by whether they ran before, during or after the migration.
+template <typename Cache>
+void resizing(std::vector<size_t>& io, Cache& cache, const size_t num, size_t to) {
+  using clock = std::chrono::steady_clock;
+  struct sample {
+    clock::time_point at;
+    double ns;
+  };
+  std::vector<std::vector<sample>> samples(num);
+  std::atomic<bool> triggered{false};
+  std::atomic<clock::rep> resize_start{0}, resize_stop{0};
+  auto origin = clock::now();
+
+  using iter = std::vector<size_t>::iterator;
+  auto fn = [&](const size_t p, const iter begin, const iter end) {
+    auto& local = samples[p];
+    local.reserve((end - begin) / 8 + 1);
+    auto trigger = begin + (end - begin) / 4;
+    for (auto it = begin; it != end; ++it) {
+      // the start is only published once resizing() is true, so no
+      // thread can take the gap before it for the end of the migration
+      if (it == trigger && !triggered.exchange(true)) {
+        auto at = clock::now();
+        cache.resize(to);
+        resize_start = (at - origin).count();
+      }
+      if ((it - begin) % 8) {
+        cache.set(*it, nullptr);
+        continue;
+      }
+      auto start = clock::now();
+      cache.set(*it, nullptr);
+      auto stop = clock::now();
+      local.push_back({stop, std::chrono::duration<double, std::nano>(stop - start).count()});
+      if (resize_start && !resize_stop && !cache.resizing()) {
+        clock::rep none = 0;
+        resize_stop.compare_exchange_strong(none, (stop - origin).count());
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  auto it = io.begin();
+  size_t stride = io.size() / num;
+  for (size_t i = 1; i < num; ++i) {
+    threads.emplace_back(fn, i, it, it + stride);
+    it += stride;
+  }
+  threads.emplace_back(fn, 0, it, io.end());
+  for (auto& th : threads) th.join();
+  auto end = clock::now();
+
+  auto start = origin + clock::duration(resize_start.load());
+  auto stop = resize_stop ? origin + clock::duration(resize_stop.load()) : end;
+  std::vector<double> phases[3];
+  for (auto& local : samples)
+    for (auto [at, ns] : local)
+      phases[(at >= start) + (at >= stop)].push_back(ns);
+
+  const char* names[] = {"before", "during", "after"};
+  clock::time_point bounds[] = {origin, start, stop, end};
+  std::cout << "    migration_us: "
+            << std::chrono::duration<double, std::micro>(stop - start).count()
+            << std::endl;
+  for (size_t ph = 0; ph < 3; ++ph) {
+    auto& lat = phases[ph];
+    auto us = std::chrono::duration<double, std::micro>(bounds[ph + 1] - bounds[ph]).count();
+    double p99 = 0;
+    if (!lat.empty()) {
+      auto nth = lat.begin() + (lat.size() - 1) * 99 / 100;
+      std::nth_element(lat.begin(), nth, lat.end());
+      p99 = *nth;
+    }
+    std::cout << "    " << names[ph] << ":\n"
+              << "      throughput: " << (us > 0 ? lat.size() * 8 / us : 0) << '\n'
+              << "      p99_ns: " << p99 << std::endl;
+  }
 }
 
 int main(int argc, char const* argv[]) {
   if (argc < 2) return 1;
 
-  auto fname = std::string(argv[1]);
-
-  std::vector<size_t> io;
-  if (fname.ends_with(".lis"))
-    io = load_arc(fname);
-  else if (fname.ends_with(".yaml"))
-    io = load_zipf(fname);
-  else
-    io = load_wiki(fname);
+  std::vector<double> times;
+  auto io = load_trace(argv[1], &times);
+  if (io.empty()) return 1;
 
   static const size_t N = std::min(std::thread::hardware_concurrency(), 10U);
+
+  // open [poisson|trace] [hash|rr] [threads]
+  if (argc > 2 && std::string(argv[2]) == "open") {
+    bool timed = argc > 3 && std::string(argv[3]) == "trace";
+    bool by_hash = !(argc > 4 && std::string(argv[4]) == "rr");
+    size_t num = argc > 5 ? std::stoul(argv[5]) : N;
+    if (timed && times.empty()) {
+      std::cerr << argv[1] << " has no timestamps" << std::endl;
+      return 1;
+    }
+    if (!timed) times.clear();
+
+    using pd = fano_elias::par_pd<>;
+    using felru = FELRU::cache<mul_shift, FELRU::ptr, FELRU::spin_lock>;
+    std::cout << "fe_lru:" << std::endl;
+    load_curve<par_bin_cache<pd, mul_shift>>(io, times, num, by_hash, [] {
+      return par_bin_cache<pd, mul_shift>(1 << 17);
+    });
+    std::cout << "felru:" << std::endl;
+    load_curve<felru>(io, times, num, by_hash, [] { return felru(1 << 17); });
+    return 0;
+  }
+
+  if (argc > 2 && std::string(argv[2]) == "resize") {
+    std::cout << "fe_lru_resize:" << std::endl;
+    using pd = fano_elias::par_pd<>;
+    for (auto num = N; num >= 1; --num) {
+      std::cout << "  -\n"
+                << "    num: " << num << std::endl;
+      lh_bin_cache<pd, mul_shift> cache(1 << 17, 1 << 19);
+      resizing(io, cache, num, 1 << 19);
+    }
+    return 0;
+  }
   
 
   std::cout << "fe_lru:" << std::endl;
@@ -70,4 +300,30 @@ int main(int argc, char const* argv[]) {
     par_bin_cache<pd, mul_shift> cache(1 << 17);
     throughput(io, cache, num);
   }
+
+  std::cout << "felru:" << std::endl;
+  using felru = FELRU::cache<mul_shift, FELRU::ptr, FELRU::spin_lock>;
+
+  for (auto num = N; num >= 1; --num) {
+    std::cout << "  -\n"
+	      << "    num: " << num << std::endl;
+    felru cache(1 << 17);
+    throughput(io, cache, num);
+  }
+
+  std::cout << "sieve:" << std::endl;
+  for (auto num = N; num >= 1; --num) {
+    std::cout << "  -\n"
+              << "    num: " << num << std::endl;
+    fifo::par_sieve cache(1 << 17);
+    throughput(io, cache, num);
+  }
+
+  std::cout << "s3fifo:" << std::endl;
+  for (auto num = N; num >= 1; --num) {
+    std::cout << "  -\n"
+              << "    num: " << num << std::endl;
+    fifo::par_s3fifo cache(1 << 17);
+    throughput(io, cache, num);
+  }
 }
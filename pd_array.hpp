@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+
+// Array of pocket dictionaries behind the bin caches. It normally owns a
+// heap allocation, but can also adopt memory such as an mmap'd snapshot
+// (see snapshot.hpp), in which case release is called on destruction.
+// It can be moved but not copied, so a cache never silently shares its
+// dictionaries with another.
+template <class T>
+struct pd_array {
+  std::unique_ptr<T[], std::function<void(T*)>> base;
+  size_t count = 0;
+
+  pd_array(size_t count)
+      : base(new T[count](), [](T* data) { delete[] data; }), count(count) {}
+  pd_array(T* data, size_t count, std::function<void(T*)> release)
+      : base(data, std::move(release)), count(count) {}
+
+  T& operator[](size_t i) { return base[i]; }
+  const T& operator[](size_t i) const { return base[i]; }
+  size_t size() const { return count; }
+  T* begin() { return base.get(); }
+  T* end() { return base.get() + count; }
+};
+
+// Per pd locking for code shared by the serial and concurrent caches:
+// fano_elias::par_pd has lock() / unlock(), FELRU::PD a lock member, and
+// the serial pds have neither.
+
+template <class pd>
+void pd_lock(pd& pd_) {
+  if constexpr (requires { pd_.lock(); }) pd_.lock();
+  else if constexpr (requires { pd_.lock.lock(); }) pd_.lock.lock();
+}
+
+template <class pd>
+void pd_unlock(pd& pd_) {
+  if constexpr (requires { pd_.unlock(); }) pd_.unlock();
+  else if constexpr (requires { pd_.lock.unlock(); }) pd_.lock.unlock();
+}
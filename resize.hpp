@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cinttypes>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "pd_array.hpp"
+#include "stats.hpp"
+
+// reference : https://dl.acm.org/doi/10.5555/1286887.1286895
+// A bin cache that grows or shrinks in place by linear hashing. With B
+// buckets and L = 2^floor(log2 B), a hash h goes to bucket h mod L, or
+// to h mod 2L if that is below B - L. Growing by one bucket splits bucket
+// B - L into itself and B, shrinking merges bucket B - 1 back into its
+// buddy, so a resize is a sequence of small independent steps. set()
+// performs per_op of them while a resize is pending, which keeps its
+// latency flat, and with a pd that has a lock (par_pd) other threads keep
+// working on every bucket that is not being migrated at that moment.
+// Fingerprints are the top 16 bits of the hash so they do not depend on B.
+template <class pd, typename Hash = std::identity>
+struct lh_bin_cache {
+  static const size_t segment = 1024;  // pds per allocation
+
+  const size_t max_entries;
+  const size_t per_op;
+  std::vector<std::atomic<pd*>> dir;
+  std::atomic<size_t> entries;
+  std::atomic<size_t> target;
+  std::mutex resize_lock;
+  std::vector<std::pair<uint16_t, size_t>> moving;
+  Hash hasher;
+  [[no_unique_address]] stats::counters counters;
+
+  lh_bin_cache(size_t size, size_t max_size = 0, size_t per_op = 1)
+      : max_entries(std::max(size, max_size) / 27),
+        per_op(per_op),
+        dir(max_entries / segment + 1),
+        entries(std::max<size_t>(size / 27, 1)),
+        target(entries.load()) {
+    for (size_t b = 0; b < entries; b += segment) reserve(b);
+  }
+
+  ~lh_bin_cache() {
+    for (auto& seg : dir) delete[] seg.load();
+  }
+
+  // Sets the capacity to reach, the migration happens during later set()
+  // calls (or explicit migrate() calls).
+  void resize(size_t size) {
+    target = std::clamp<size_t>(size / 27, 1, max_entries);
+  }
+
+  bool resizing() const { return target.load() != entries.load(); }
+
+  size_t capacity() const { return entries.load() * 27; }
+
+  auto set(size_t key, void*) {
+    auto hash = hasher(key);
+    uint16_t fp = static_cast<uint16_t>(hash >> 48);
+    bool hit;
+    for (;;) {
+      auto b = route(hash, entries.load(std::memory_order_acquire));
+      auto& pd_ = bucket(b);
+      pd_lock(pd_);
+      // a migration of b may have moved the key before we got the lock
+      if (route(hash, entries.load(std::memory_order_acquire)) != b) {
+        pd_unlock(pd_);
+        continue;
+      }
+      hit = stats::counted_set(counters, pd_, fp, key);
+      pd_unlock(pd_);
+      break;
+    }
+    if (target.load(std::memory_order_relaxed) !=
+        entries.load(std::memory_order_relaxed))
+      migrate(per_op);
+    return hit;
+  }
+
+  // Splits or merges up to n buckets towards the target. Returns at once
+  // if another thread is already migrating.
+  void migrate(size_t n) {
+    std::unique_lock guard(resize_lock, std::try_to_lock);
+    if (!guard) return;
+    for (; n > 0; --n) {
+      auto buckets = entries.load(std::memory_order_relaxed);
+      auto goal = target.load(std::memory_order_relaxed);
+      if (buckets < goal)
+        split(buckets);
+      else if (buckets > goal)
+        merge(buckets);
+      else
+        break;
+    }
+  }
+
+  static size_t route(uint64_t hash, size_t buckets) {
+    auto low = std::bit_floor(buckets);
+    auto b = hash & (low - 1);
+    return b < buckets - low ? hash & ((low << 1) - 1) : b;
+  }
+
+  pd& bucket(size_t b) {
+    return dir[b / segment].load(std::memory_order_acquire)[b % segment];
+  }
+
+  void reserve(size_t b) {
+    auto& seg = dir[b / segment];
+    if (!seg.load(std::memory_order_relaxed))
+      seg.store(new pd[segment](), std::memory_order_release);
+  }
+
+  void split(size_t buckets) {
+    auto low = std::bit_floor(buckets);
+    auto src = buckets - low;
+    reserve(buckets);
+    auto& from = bucket(src);
+    auto& to = bucket(buckets);
+
+    pd_lock(from);
+    pd_lock(to);
+    moving.clear();
+    from.for_each([this](uint16_t fp, size_t key) { moving.emplace_back(fp, key); });
+    from.clear();
+    to.clear();
+    for (auto [fp, key] : moving) {
+      if (route(hasher(key), buckets + 1) == src)
+        from.insert(fp, key);
+      else
+        to.insert(fp, key);
+    }
+    entries.store(buckets + 1, std::memory_order_release);
+    pd_unlock(to);
+    pd_unlock(from);
+  }
+
+  // The merged bucket keeps the most recent keys of the pair, with the
+  // keys of the removed bucket ranked above those of its buddy.
+  void merge(size_t buckets) {
+    auto last = buckets - 1;
+    auto& from = bucket(last);
+    auto& to = bucket(last - std::bit_floor(last));
+
+    pd_lock(to);
+    pd_lock(from);
+    moving.clear();
+    auto collect = [this](uint16_t fp, size_t key) { moving.emplace_back(fp, key); };
+    to.for_each(collect);
+    from.for_each(collect);
+    from.clear();
+    to.clear();
+    for (auto [fp, key] : moving) to.insert(fp, key);
+    entries.store(last, std::memory_order_release);
+    pd_unlock(from);
+    pd_unlock(to);
+  }
+
+  // occupancy of the buckets in use, taken while no resize step runs
+  stats::snapshot stats() {
+    auto s = counters.read();
+    std::lock_guard guard(resize_lock);
+    s.occupancy.assign(28, 0);
+    for (size_t b = 0, n = entries.load(); b < n; ++b) {
+      auto& pd_ = bucket(b);
+      pd_lock(pd_);
+      ++s.occupancy[std::min<size_t>(stats::entries(pd_), 27)];
+      pd_unlock(pd_);
+    }
+    return s;
+  }
+
+  void describe() {
+    std::cout
+        << "Cache Eviction Policy: FELRU, linear hashing\n"
+        << "Cache size: " << capacity() << std::endl;
+  }
+};
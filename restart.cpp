@@ -0,0 +1,115 @@
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cache.hpp"
+#include "felru.hpp"
+#include "io.hpp"
+#include "snapshot.hpp"
+
+using iter = std::vector<size_t>::iterator;
+
+template <typename Cache>
+auto hits(Cache& cache, iter begin, iter end) {
+  size_t hit = 0;
+  for (auto it = begin; it != end; ++it)
+    hit += cache.set(*it, nullptr);
+  return hit;
+}
+
+template <typename Fn>
+double elapsed_us(Fn fn) {
+  auto start = std::chrono::high_resolution_clock::now();
+  fn();
+  auto stop = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::micro>(stop - start).count();
+}
+
+// Warms a cache on the first half of the trace and snapshots it, then
+// replays the second half on a cold cache and on the restored one,
+// reporting the hit rate of each window of the second half.
+template <typename Cache>
+void restart(std::vector<size_t>& io, size_t size, std::string path) {
+  auto mid = io.begin() + io.size() / 2;
+  {
+    Cache warm(size);
+    hits(warm, io.begin(), mid);
+    bool ok = false;
+    auto save_us = elapsed_us([&] { ok = snapshot::save(warm, path); });
+    if (!ok) return;
+    std::cout << "  save_ms: " << save_us / 1e3 << std::endl;
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  auto restored = snapshot::restore<Cache>(path);
+  auto stop = std::chrono::high_resolution_clock::now();
+  if (!restored) return;
+  auto restore_us = std::chrono::duration<double, std::micro>(stop - start).count();
+  std::cout << "  restore_us: " << restore_us << '\n'
+            << "  windows:" << std::endl;
+
+  Cache cold(size);
+  static const size_t W = 16;
+  size_t stride = (io.end() - mid) / W;
+  for (size_t w = 0; w < W; ++w) {
+    auto begin = mid + w * stride;
+    auto end = w + 1 == W ? io.end() : begin + stride;
+    auto total = (double)(end - begin);
+    std::cout << "    -\n"
+              << "      cold: " << hits(cold, begin, end) / total << '\n'
+              << "      warm: " << hits(*restored, begin, end) / total << std::endl;
+  }
+}
+
+// Times the second half with and without a background snapshot running
+// alongside it, to show that snapshots do not stall set().
+template <typename Cache>
+void background(std::vector<size_t>& io, size_t size, std::string path) {
+  auto mid = io.begin() + io.size() / 2;
+  Cache quiet(size), busy(size);
+  hits(quiet, io.begin(), mid);
+  hits(busy, io.begin(), mid);
+
+  auto set_us = elapsed_us([&] { hits(quiet, mid, io.end()); });
+  snapshot::writer<Cache> w(busy, path);
+  std::thread th;
+  auto busy_us = elapsed_us([&] {
+    th = w.background();
+    hits(busy, mid, io.end());
+  });
+  th.join();
+
+  auto ops = (double)(io.end() - mid);
+  std::cout << "  set_ns: " << set_us * 1e3 / ops << '\n'
+            << "  set_ns_during_snapshot: " << busy_us * 1e3 / ops << '\n'
+            << "  snapshot_ok: " << w.ok << std::endl;
+}
+
+// restart.out <trace or spec> [snapshot file]
+int main(int argc, char const* argv[]) {
+  if (argc < 2) return 1;
+
+  auto io = load_trace(argv[1]);
+  if (io.empty()) return 1;
+  auto path = std::string(argc > 2 ? argv[2] : "cache.snap");
+  static const size_t size = 1 << 17;
+
+  std::cout << "fe_lru:" << std::endl;
+  using pd = fano_elias::pd<>;
+  restart<bin_cache<pd, mul_shift>>(io, size, path);
+
+  std::cout << "par_fe_lru:" << std::endl;
+  using par_pd = fano_elias::par_pd<>;
+  background<par_bin_cache<par_pd, mul_shift>>(io, size, path);
+
+  std::cout << "lru:" << std::endl;
+  restart<lru>(io, size, path);
+
+  std::cout << "lfu:" << std::endl;
+  restart<lfu>(io, size, path);
+
+  std::remove(path.c_str());
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+
+#include "cache.hpp"
+#include "pd_array.hpp"
+
+// Warm restart support.
+//
+// Bin caches are written as their raw array of pocket dictionaries behind
+// a one page header, so restore() can mmap the file and hand the mapping
+// to the cache as is: it is usable at once and buckets page in as they
+// are touched. The list based engines of cache.hpp are written as their
+// keys in eviction order, with whatever per key state they rank by, and
+// are rebuilt on restore.
+
+namespace snapshot {
+
+static const uint32_t version = 1;
+static const size_t page = 4096;
+
+struct header {
+  char magic[8] = {'P', 'D', 'S', 'N', 'A', 'P', 0, 0};
+  uint32_t version = snapshot::version;
+  uint32_t record_size = 0;  // sizeof(pd), or bytes per key for lists
+  uint64_t count = 0;        // pds, or keys for lists
+  uint64_t layout = 0;       // hash of the cache type, guards restores
+  uint64_t size = 0;         // capacity of a list engine
+  uint64_t t = 0;            // logical clock of lfu / lru_k
+
+  bool valid(const header& expected) const {
+    return std::memcmp(magic, expected.magic, sizeof(magic)) == 0 &&
+           version == expected.version &&
+           record_size == expected.record_size &&
+           layout == expected.layout;
+  }
+};
+
+template <class Cache>
+using pd_of = std::remove_reference_t<decltype(std::declval<Cache&>().pds[0])>;
+
+// T is the whole cache type, so that a snapshot does not restore into a
+// cache with another Hash, which would route keys to the wrong pds
+template <class T>
+header header_of(uint32_t record_size, uint64_t count) {
+  header h;
+  h.record_size = record_size;
+  h.count = count;
+  h.layout = std::hash<std::string_view>()(typeid(T).name());
+  return h;
+}
+
+// Writes the pds of a bin cache to path, a batch at a time. Every pd is
+// copied under its own lock, if it has one, so a concurrent set() waits
+// for at most one copy and the result is a fuzzy snapshot. The file is
+// written beside path and renamed over it once complete.
+template <class Cache>
+struct writer {
+  using pd = pd_of<Cache>;
+
+  Cache& cache;
+  std::string path;
+  int fd = -1;
+  size_t next = 0;
+  bool ok = false;
+  std::vector<char> buf;
+
+  writer(Cache& cache, std::string path) : cache(cache), path(path) {
+    fd = ::open((path + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      std::perror("snapshot");
+      return;
+    }
+    std::vector<char> first(page, 0);
+    auto h = header_of<Cache>(sizeof(pd), cache.pds.size());
+    std::memcpy(first.data(), &h, sizeof(h));
+    ok = ::pwrite(fd, first.data(), page, 0) == static_cast<ssize_t>(page);
+  }
+
+  ~writer() {
+    if (fd >= 0) ::close(fd);
+  }
+
+  // Copies the next n pds, returns false once the snapshot is finished
+  bool step(size_t n = 256) {
+    if (fd < 0) return false;
+    n = std::min(n, cache.pds.size() - next);
+    buf.resize(n * sizeof(pd));
+    for (size_t i = 0; i < n; ++i) {
+      auto& pd_ = cache.pds[next + i];
+      auto copy = buf.data() + i * sizeof(pd);
+      pd_lock(pd_);
+      std::memcpy(copy, static_cast<const void*>(&pd_), sizeof(pd));
+      pd_unlock(pd_);
+      pd_unlock(*reinterpret_cast<pd*>(copy));  // copied while held
+    }
+    auto offset = page + next * sizeof(pd);
+    ok &= ::pwrite(fd, buf.data(), buf.size(), offset) == static_cast<ssize_t>(buf.size());
+    next += n;
+    if (ok && next < cache.pds.size()) return true;
+
+    ok &= ::fsync(fd) == 0;
+    ::close(fd);
+    fd = -1;
+    ok = ok && std::rename((path + ".tmp").c_str(), path.c_str()) == 0;
+    return false;
+  }
+
+  // Runs step() to completion on another thread. Only safe while the
+  // cache is in use if its pds have a lock (par_bin_cache).
+  std::thread background() {
+    return std::thread([this] { while (step()) ; });
+  }
+};
+
+template <class T>
+void put(std::ostream& os, T val) {
+  os.write(reinterpret_cast<const char*>(&val), sizeof(val));
+}
+
+template <class T = uint64_t>
+T get(std::istream& is) {
+  T val{};
+  is.read(reinterpret_cast<char*>(&val), sizeof(val));
+  return val;
+}
+
+// One record per key, least valuable first so that replaying them in
+// order through set() rebuilds the same order.
+
+inline void write(std::ostream& os, const lru& c) {
+  for (auto it = c.lru_.rbegin(); it != c.lru_.rend(); ++it) put(os, *it);
+}
+inline void read(std::istream& is, lru& c, const header& h) {
+  for (size_t i = 0; i < h.count; ++i) c.set(get(is), nullptr);
+}
+
+inline void write(std::ostream& os, const mru& c) {
+  for (auto it = c.mru_.rbegin(); it != c.mru_.rend(); ++it) put(os, *it);
+}
+inline void read(std::istream& is, mru& c, const header& h) {
+  for (size_t i = 0; i < h.count; ++i) c.set(get(is), nullptr);
+}
+
+inline void write(std::ostream& os, const clock_lru& c) {
+  for (auto it = c.clock_.rbegin(); it != c.clock_.rend(); ++it) {
+    put(os, it->key);
+    put(os, static_cast<uint64_t>(it->bit));
+  }
+}
+inline void read(std::istream& is, clock_lru& c, const header& h) {
+  for (size_t i = 0; i < h.count; ++i) {
+    c.set(get(is), nullptr);
+    c.clock_.front().bit = get(is);
+  }
+}
+
+inline void write(std::ostream& os, const lfu& c) {
+  for (auto& frame : c.lru_) {
+    put(os, frame.key);
+    put(os, frame.freq);
+    put(os, frame.last);
+  }
+}
+inline void read(std::istream& is, lfu& c, const header& h) {
+  for (size_t i = 0; i < h.count; ++i) {
+    auto key = get(is), freq = get(is), last = get(is);
+    auto it = c.lru_.insert({key, freq, last}).first;
+    c.table.insert({key, {it, nullptr}});
+  }
+  c.t = h.t;
+}
+
+template <size_t K>
+void write(std::ostream& os, const lru_k<K>& c) {
+  for (auto& frame : c.lru_) {
+    put(os, frame.key);
+    put(os, frame.freq);
+    for (auto w : frame.window) put(os, w);
+  }
+}
+template <size_t K>
+void read(std::istream& is, lru_k<K>& c, const header& h) {
+  for (size_t i = 0; i < h.count; ++i) {
+    typename lru_k<K>::frame frame{get(is), get(is), {}};
+    for (auto& w : frame.window) w = get(is);
+    auto it = c.lru_.insert(frame).first;
+    c.table.insert({frame.key, {it, nullptr}});
+  }
+  c.t = h.t;
+}
+
+template <class Cache>
+constexpr uint32_t record_size() {
+  if constexpr (std::is_same_v<Cache, clock_lru>) return 16;
+  else if constexpr (std::is_same_v<Cache, lfu>) return 24;
+  else if constexpr (requires { Cache::frame::window; })
+    return sizeof(Cache::frame::window) + 16;
+  else return 8;
+}
+
+template <class Cache>
+bool save(Cache& cache, std::string path) {
+  if constexpr (requires { cache.pds; }) {
+    writer<Cache> w(cache, path);
+    while (w.step()) ;
+    return w.ok;
+  } else {
+    std::ofstream os(path + ".tmp", std::ios::binary);
+    auto h = header_of<Cache>(record_size<Cache>(), cache.table.size());
+    h.size = cache.size;
+    if constexpr (requires { cache.t; }) h.t = cache.t;
+    put(os, h);
+    write(os, cache);
+    os.close();
+    return os.good() && std::rename((path + ".tmp").c_str(), path.c_str()) == 0;
+  }
+}
+
+// Bin caches come back as a private (copy on write) mapping of the file,
+// lists are read back in full.
+template <class Cache>
+std::optional<Cache> restore(std::string path) {
+  if constexpr (requires(Cache c) { c.pds; }) {
+    using pd = pd_of<Cache>;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return {};
+
+    header h;
+    struct stat st;
+    bool valid = ::pread(fd, &h, sizeof(h), 0) == sizeof(h) &&
+                 h.valid(header_of<Cache>(sizeof(pd), 0)) &&
+                 ::fstat(fd, &st) == 0 &&
+                 static_cast<size_t>(st.st_size) >= page + h.count * sizeof(pd);
+    if (!valid) {
+      ::close(fd);
+      std::cerr << "snapshot: " << path << " does not match this cache" << std::endl;
+      return {};
+    }
+
+    auto len = page + h.count * sizeof(pd);
+    void* base = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) return {};
+    ::madvise(base, len, MADV_RANDOM);
+
+    auto pds = reinterpret_cast<pd*>(static_cast<char*>(base) + page);
+    return Cache(pd_array<pd>(pds, h.count, [base, len](pd*) { ::munmap(base, len); }));
+  } else {
+    std::ifstream is(path, std::ios::binary);
+    auto h = get<header>(is);
+    if (!is || !h.valid(header_of<Cache>(record_size<Cache>(), 0))) {
+      std::cerr << "snapshot: " << path << " does not match this cache" << std::endl;
+      return {};
+    }
+    std::optional<Cache> cache(std::in_place, h.size);
+    read(is, *cache, h);
+    if (!is) return {};
+    return cache;
+  }
+}
+
+};  // namespace snapshot
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cinttypes>
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "pd_array.hpp"
+
+// Engine introspection. Every engine has a `counters` member it bumps on
+// hits, misses, inserts and evictions, and a stats() call returning a
+// snapshot of them together with state it reads at that moment (pd
+// occupancy, list length, frequencies). Wrappers around another engine
+// (adaptive, ttl_cache, loading::synchronized) return that engine's
+// stats(); loading_cache adds its lookups of pending loads as misses.
+//
+// Counting is compiled in with -DCACHE_STATS (make STATS=1). Without it
+// counters is an empty [[no_unique_address]] member whose add() does
+// nothing, so the engines cost what they did before, and stats() only
+// reports the structural part.
+
+namespace stats {
+
+enum counter { hits, misses, inserts, evictions, false_matches, count };
+
+inline const char* names[count] = {"hits", "misses", "inserts", "evictions",
+                                   "false_matches"};
+
+#ifdef CACHE_STATS
+inline constexpr bool enabled = true;
+#else
+inline constexpr bool enabled = false;
+#endif
+
+struct snapshot {
+  std::array<uint64_t, count> counters{};
+  std::vector<uint64_t> occupancy;        // pds holding i entries
+  size_t length = 0;                      // entries in the recency order
+  std::map<size_t, uint64_t> frequency;   // entries by power of two bucket
+
+  uint64_t operator[](counter c) const { return counters[c]; }
+
+  void dump(std::ostream& os, const std::string& indent = "    ") const {
+    os << indent << "stats:\n";
+    if (enabled)
+      for (size_t c = 0; c < count; ++c)
+        os << indent << "  " << names[c] << ": " << counters[c] << '\n';
+    if (length) os << indent << "  length: " << length << '\n';
+    if (!occupancy.empty()) {
+      os << indent << "  occupancy: [";
+      for (size_t i = 0; i < occupancy.size(); ++i)
+        os << (i ? ", " : "") << occupancy[i];
+      os << "]\n";
+    }
+    if (!frequency.empty()) {
+      os << indent << "  frequency:\n";
+      for (auto [from, n] : frequency)
+        os << indent << "    " << from << ": " << n << '\n';
+    }
+    os.flush();
+  }
+};
+
+#ifdef CACHE_STATS
+
+// One cache line of counters per thread slot, so threads never write to
+// the same line. Threads take slots round robin on first use. Copies of
+// an engine share its counters.
+struct counters {
+  static const size_t slots = 64;
+
+  struct alignas(64) shard {
+    std::atomic<uint64_t> c[count] = {};
+  };
+
+  std::shared_ptr<shard[]> shards{new shard[slots]()};
+
+  static size_t slot() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t mine = next.fetch_add(1, std::memory_order_relaxed) % slots;
+    return mine;
+  }
+
+  void add(counter c, uint64_t n = 1) {
+    shards[slot()].c[c].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  snapshot read() const {
+    snapshot s;
+    for (size_t i = 0; i < slots; ++i)
+      for (size_t c = 0; c < count; ++c)
+        s.counters[c] += shards[i].c[c].load(std::memory_order_relaxed);
+    return s;
+  }
+};
+
+#else
+
+struct counters {
+  void add(counter, uint64_t = 1) {}
+  snapshot read() const { return {}; }
+};
+
+#endif
+
+template <class pd>
+size_t entries(const pd& pd_) {
+  if constexpr (requires { pd_.occupancy(); }) return pd_.occupancy();
+  else return pd_.occupancy;
+}
+
+// The find, then insert on a miss, of the bin caches, counted. The pd
+// must be locked by the caller if needed.
+template <class pd>
+bool counted_set(counters& c, pd& pd_, uint16_t fp, size_t key) {
+  bool hit;
+  if constexpr (requires { pd_.find(fp, key, &c); })
+    hit = pd_.find(fp, key, &c).has_value();
+  else
+    hit = pd_.find(fp, key).has_value();
+  if (hit) {
+    c.add(hits);
+    return true;
+  }
+  c.add(misses);
+  c.add(inserts);
+  if (enabled && entries(pd_) >= 27) c.add(evictions);
+  pd_.insert(fp, key);
+  return false;
+}
+
+// Histogram of pd occupancy, each pd read under its lock if it has one
+template <class pd>
+void occupancy(snapshot& s, pd_array<pd>& pds) {
+  s.occupancy.assign(28, 0);
+  for (auto& pd_ : pds) {
+    pd_lock(pd_);
+    auto n = entries(pd_);
+    pd_unlock(pd_);
+    ++s.occupancy[std::min<size_t>(n, 27)];
+  }
+}
+
+// Adds every frame of order to the frequency histogram, in buckets of
+// [2^i, 2^(i+1))
+template <class Order>
+void frequency(snapshot& s, const Order& order) {
+  for (auto& frame : order) {
+    size_t f = frame.freq;
+    ++s.frequency[f ? std::bit_floor(f) : 0];
+  }
+}
+
+// Calls fn() at most once per period. Only every 1024th call reads the
+// clock.
+struct periodic {
+  using clock = std::chrono::steady_clock;
+  const clock::duration period;
+  clock::time_point next;
+  size_t calls = 0;
+
+  periodic(clock::duration period) : period(period), next(clock::now() + period) {}
+
+  template <typename Fn>
+  void operator()(Fn fn) {
+    if (++calls % 1024) return;
+    auto now = clock::now();
+    if (now < next) return;
+    next = now + period;
+    fn();
+  }
+};
+
+};  // namespace stats
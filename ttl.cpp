@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cache.hpp"
+#include "felru.hpp"
+#include "io.hpp"
+#include "ttl.hpp"
+
+// Each key gets one of three TTLs, base, 4 * base or 16 * base accesses,
+// picked by its hash. An access to an entry past its TTL is a miss.
+struct ttl_trace {
+  uint64_t base;
+  uint64_t operator()(size_t key) const {
+    return base << (2 * (workload::mix(key) % 3));
+  }
+};
+
+template <typename Fn>
+double ns_per_op(size_t ops, Fn fn) {
+  auto start = std::chrono::high_resolution_clock::now();
+  fn();
+  auto stop = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() / ops;
+}
+
+template <class Cache>
+void plain(std::vector<size_t>& io, Cache& cache) {
+  size_t hit = 0;
+  auto ns = ns_per_op(io.size(), [&] {
+    for (auto key : io) hit += cache.set(key, nullptr);
+  });
+  std::cout << "  plain:\n"
+            << "    ns_per_op: " << ns << std::endl;
+  if constexpr (stats::enabled) cache.stats().dump(std::cout);
+}
+
+template <class Cache>
+void expiring(const char* name, std::vector<size_t>& io, ttl_trace ttl, Cache& cache) {
+  size_t hit = 0;
+  auto ns = ns_per_op(io.size(), [&] {
+    for (size_t now = 0; now < io.size(); ++now)
+      hit += cache.set(io[now], nullptr, ttl(io[now]), now);
+  });
+  std::cout << "  " << name << ":\n"
+            << "    ns_per_op: " << ns << '\n'
+            << "    hit_rate: " << (double)hit / (double)io.size() << '\n'
+            << "    expired: " << cache.expired << std::endl;
+  if constexpr (stats::enabled) cache.stats().dump(std::cout);
+}
+
+// ttl.out <trace or spec> [base TTL in accesses]
+int main(int argc, char const* argv[]) {
+  if (argc < 2) return 1;
+
+  auto io = load_trace(argv[1]);
+  if (io.empty()) return 1;
+  ttl_trace ttl{argc > 2 ? std::stoul(argv[2]) : 1UL << 14};
+  static const size_t size = 1 << 17;
+
+  std::cout << "lru:" << std::endl;
+  {
+    lru cache(size);
+    plain(io, cache);
+  }
+  {
+    ttl_cache<lru> cache(size, false);
+    expiring("lazy", io, ttl, cache);
+  }
+  {
+    ttl_cache<lru> cache(size, true);
+    expiring("wheel", io, ttl, cache);
+  }
+
+  std::cout << "fe_lru:" << std::endl;
+  {
+    bin_cache<fano_elias::pd<>, mul_shift> cache(size);
+    plain(io, cache);
+  }
+  // 32 to 64 epochs for the longest TTL, 16 * base, so that an epoch,
+  // by which deadlines are rounded up, is at most half the shortest TTL
+  unsigned shift = std::max<uint64_t>(std::bit_width(ttl.base << 4), 6) - 6;
+  if ((1UL << shift) > ttl.base) {
+    std::cerr << "ttl: base TTL " << ttl.base << " is shorter than an epoch" << std::endl;
+    return 1;
+  }
+  using pd = fano_elias::ttl_pd<>;
+  {
+    ttl_bin_cache<pd, mul_shift> cache(size, shift, false);
+    expiring("lazy", io, ttl, cache);
+  }
+  {
+    ttl_bin_cache<pd, mul_shift> cache(size, shift, true);
+    expiring("reclaim", io, ttl, cache);
+  }
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cinttypes>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <unordered_map>
+
+#include "felru.hpp"
+#include "pd_array.hpp"
+#include "stats.hpp"
+
+// Per entry time to live. Time is whatever the caller passes as now to
+// set(), the benchmarks use the index of the access in the trace.
+
+// reference : https://doi.org/10.1145/41457.37504
+// (Varghese and Lauck, hashed and hierarchical timing wheels)
+// levels wheels of 64 slots. A timer goes to the level of the highest
+// 6 bit group in which its deadline differs from now, and moves down a
+// level whenever its slot comes up, so scheduling and cancelling are O(1)
+// and expiry is amortized O(1) per timer.
+struct timing_wheel {
+  static const size_t bits = 6;
+  static const size_t slots = 1UL << bits;
+  static const size_t levels = 4;
+  static const uint64_t span = 1UL << (bits * levels);
+
+  struct timer {
+    uint64_t deadline = 0;
+    size_t key = 0;
+    timer* prev = nullptr;
+    timer* next = nullptr;
+  };
+
+  timer wheel[levels][slots];
+  uint64_t now = 0;
+
+  timing_wheel() {
+    for (auto& level : wheel)
+      for (auto& head : level) head.prev = head.next = &head;
+  }
+  timing_wheel(const timing_wheel&) = delete;
+
+  // due timers fire on the next tick
+  void schedule(timer& t, uint64_t deadline) {
+    t.deadline = deadline;
+    place(t, now + 1);
+  }
+
+  // far timers wait in the top level until less than a full turn away
+  void place(timer& t, uint64_t earliest) {
+    auto deadline = std::clamp(t.deadline, earliest, now + span - 1);
+    size_t level = std::min((std::bit_width((deadline ^ now) | 1) - 1) / bits, levels - 1);
+    auto& head = wheel[level][(deadline >> (bits * level)) & (slots - 1)];
+    t.prev = head.prev;
+    t.next = &head;
+    head.prev->next = &t;
+    head.prev = &t;
+  }
+
+  static bool scheduled(const timer& t) { return t.next; }
+
+  void cancel(timer& t) {
+    if (!scheduled(t)) return;
+    t.prev->next = t.next;
+    t.next->prev = t.prev;
+    t.prev = t.next = nullptr;
+  }
+
+  // Moves time forward to `to`, calling fn(key) for every timer that
+  // expires on the way. fn may cancel or schedule other timers.
+  template <typename Fn>
+  void advance(uint64_t to, Fn fn) {
+    while (now < to) {
+      ++now;
+      size_t wrapped = 1;
+      while (wrapped < levels && (now & ((1UL << (bits * wrapped)) - 1)) == 0)
+        ++wrapped;
+      for (auto level = wrapped; --level > 0;) {
+        auto& head = wheel[level][(now >> (bits * level)) & (slots - 1)];
+        while (head.next != &head) {
+          auto& t = *head.next;
+          cancel(t);
+          place(t, now);
+        }
+      }
+      auto& head = wheel[0][now & (slots - 1)];
+      while (head.next != &head) {
+        auto& t = *head.next;
+        cancel(t);
+        fn(t.key);
+      }
+    }
+  }
+};
+
+// Adds TTLs to an engine of cache.hpp. An expired entry is always a miss.
+// Lazily, set() drops an entry it finds expired. With proactive, a timing
+// wheel also erases every entry from the engine as soon as it expires,
+// so dead entries never push out live ones. Timers of keys the engine
+// has evicted are dropped once they are as many as its entries.
+template <class Cache>
+struct ttl_cache {
+  Cache cache;
+  const bool proactive;
+  timing_wheel wheel;
+  std::unordered_map<size_t, timing_wheel::timer> timers;
+  size_t expired = 0;
+
+  ttl_cache(size_t size, bool proactive = true) : cache(size), proactive(proactive) {
+    timers.reserve(size);
+  }
+
+  auto set(size_t key, void* val, uint64_t ttl, uint64_t now) {
+    if (proactive)
+      wheel.advance(now, [this](size_t victim) {
+        expired += cache.erase(victim);
+        timers.erase(victim);
+      });
+
+    auto timer = timers.find(key);
+    if (timer != timers.end() && timer->second.deadline <= now) {
+      expired += cache.erase(key);
+      wheel.cancel(timer->second);
+      timers.erase(timer);
+      timer = timers.end();
+    }
+
+    auto hit = cache.set(key, val);
+    // an entry evicted earlier may have left its timer behind
+    if (!hit || timer == timers.end()) {
+      if (timers.size() >= 2 * cache.size) purge();
+      auto& t = timers[key];
+      wheel.cancel(t);
+      t.key = key;
+      t.deadline = now + ttl;
+      if (proactive) wheel.schedule(t, now + ttl);
+    }
+    return hit;
+  }
+
+  // Expired entries are erased before the engine's set(), so its
+  // counters see them as misses, and not as evictions
+  stats::snapshot stats() const { return cache.stats(); }
+
+  // drops the timers of keys no longer in the engine
+  void purge() {
+    for (auto it = timers.begin(); it != timers.end();) {
+      if (cache.table.contains(it->first)) {
+        ++it;
+        continue;
+      }
+      wheel.cancel(it->second);
+      it = timers.erase(it);
+    }
+  }
+
+  void describe() {
+    std::cout << "TTL " << (proactive ? "(timing wheel) " : "(lazy) ");
+    cache.describe();
+  }
+};
+
+namespace fano_elias {
+
+// A pd that stores, beside its ptr_table, the epoch at which each entry
+// expires as one byte. Epochs are now >> epoch_shift and are compared
+// modulo 256, so TTLs must stay below 128 epochs, and so must the time
+// an entry stays past its deadline: the cache sweeps every pd often
+// enough. Expired entries are dropped when looked up, by sweep(), and,
+// with reclaim, by an insert into a full pd before anything live is
+// evicted. The drops are added to *expired if given, and a fingerprint
+// that matches another key is counted in counters.
+template <typename Evict = evict_q, typename Lock = uint8_t>
+struct ttl_pd : pd<Evict, Lock> {
+  uint8_t epoch[27] = {0};
+
+  static bool expired(uint8_t deadline, uint8_t now) {
+    return static_cast<int8_t>(now - deadline) >= 0;
+  }
+
+  std::optional<size_t> find(uint16_t fp, size_t key, uint8_t now,
+                             size_t* expired_ = nullptr,
+                             stats::counters* counters = nullptr) {
+    uint16_t q = fp & 31U;
+    uint16_t r = fp >> 5;
+
+    uint16_t begin = q ? (select(this->header, q - 1) + 1 - q) : 0;
+    uint16_t end = select(this->header, q) - q;
+
+    auto slot = std::find(this->bins + begin, this->bins + end, element{0, r});
+    if (slot == this->bins + end)
+      return {};
+    if (this->ptr_table[slot->index] != key) {
+      if (counters) counters->add(stats::false_matches);
+      return {};
+    }
+    if (expired(epoch[slot->index], now)) {
+      this->erase(slot - this->bins);
+      if (expired_) ++*expired_;
+      return {};
+    }
+    this->touch(this->bins + begin, slot);
+    return key;
+  }
+
+  // Returns the live key evicted to make room, if any
+  std::optional<size_t> insert(uint16_t fp, size_t key, uint8_t deadline, uint8_t now,
+                               bool reclaim = true, size_t* expired_ = nullptr) {
+    if (reclaim && this->freelist >= 27) {
+      auto dropped = sweep(now);
+      if (expired_) *expired_ += dropped;
+    }
+    auto evicted = pd<Evict, Lock>::insert(fp, key);
+
+    uint16_t q = fp & 31U;
+    uint16_t slot = q ? (select(this->header, q - 1) + 1 - q) : 0;
+    epoch[this->bins[slot].index] = deadline;
+    return evicted;
+  }
+
+  // drops every expired entry, returns how many
+  size_t sweep(uint8_t now) {
+    size_t dropped = 0;
+    for (auto slot = this->occupancy(); slot-- > 0;) {
+      if (expired(epoch[this->bins[slot].index], now)) {
+        this->erase(slot);
+        ++dropped;
+      }
+    }
+    return dropped;
+  }
+};
+
+};  // namespace fano_elias
+
+// bin_cache over ttl_pds. Besides the lazy checks on lookup, with
+// reclaim inserts into a full pd drop its expired entries first and each
+// set() sweeps the next sweep_per_op pds round robin. Either way the
+// sweep keeps up with a full pass every 64 epochs, so that no entry
+// outlives its deadline by the 128 epochs after which it would read as
+// live again.
+template <class pd, typename Hash = std::identity>
+struct ttl_bin_cache {
+  const size_t size = max_entries * 27;
+  const size_t entries = max_entries;
+  const unsigned epoch_shift;
+  const bool reclaim;
+  const size_t sweep_per_op;
+  pd_array<pd> pds;
+  size_t cursor = 0;
+  size_t swept = 0;
+  size_t expired = 0;
+  Hash hasher;
+  [[no_unique_address]] stats::counters counters;
+
+  ttl_bin_cache(size_t size, unsigned epoch_shift, bool reclaim = true,
+                size_t sweep_per_op = 1)
+      : size(size), entries(size / 27), epoch_shift(epoch_shift),
+        reclaim(reclaim), sweep_per_op(reclaim ? sweep_per_op : 0),
+        pds(entries) {}
+
+  auto set(size_t key, void*, uint64_t ttl, uint64_t now) {
+    uint8_t epoch = static_cast<uint8_t>(now >> epoch_shift);
+    // at least sweep_per_op pds, and a full pass every 64 epochs
+    size_t due = std::max(swept + sweep_per_op, ((now * entries) >> epoch_shift) / 64);
+    swept = std::max(swept, due - std::min(due, entries));  // one pass is enough
+    for (; swept < due; ++swept) {
+      expired += pds[cursor].sweep(epoch);
+      cursor = cursor + 1 == entries ? 0 : cursor + 1;
+    }
+
+    auto hash = hasher(key);
+    auto b = hash % entries;
+    uint16_t fp = static_cast<uint16_t>(hash / entries);
+    auto& pd_ = pds[b];
+    auto hit = pd_.find(fp, key, epoch, &expired, &counters).has_value();
+    counters.add(hit ? stats::hits : stats::misses);
+    if (hit) return true;
+    // rounded up so that an entry never expires early
+    uint8_t deadline = static_cast<uint8_t>(((now + ttl) >> epoch_shift) + 1);
+    counters.add(stats::inserts);
+    if (pd_.insert(fp, key, deadline, epoch, reclaim, &expired))
+      counters.add(stats::evictions);
+    return false;
+  }
+
+  // expired entries, dropped without evicting, are in expired
+  stats::snapshot stats() {
+    auto s = counters.read();
+    stats::occupancy(s, pds);
+    return s;
+  }
+
+  void describe() {
+    std::cout
+        << "Cache Eviction Policy: FELRU with TTL\n"
+        << "Cache size: " << size << std::endl;
+  }
+};
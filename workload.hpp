@@ -0,0 +1,326 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cinttypes>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// In-process synthetic workloads. A spec looks like
+//   zipf:n=1e6,s=0.9,len=8388608,seed=1
+// i.e. a generator name optionally followed by comma separated parameters.
+// Generation is split into fixed size chunks, each with its own random
+// stream, so the output only depends on the spec and not on the number of
+// threads used to produce it.
+
+namespace workload {
+
+// reference : https://prng.di.unimi.it/splitmix64.c
+inline uint64_t mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15UL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+  return x ^ (x >> 31);
+}
+
+// reference : https://prng.di.unimi.it/xoshiro256starstar.c
+struct rng {
+  uint64_t s[4];
+
+  rng(uint64_t seed) {
+    for (auto& word : s) word = seed = mix(seed);
+  }
+
+  uint64_t operator()() {
+    auto result = std::rotl(s[1] * 5, 7) * 9;
+    auto t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = std::rotl(s[3], 45);
+    return result;
+  }
+
+  // in [0, 1)
+  double uniform() { return static_cast<double>((*this)() >> 11) * 0x1.0p-53; }
+
+  // in [0, n)
+  size_t below(size_t n) {
+    return static_cast<unsigned __int128>((*this)()) * n >> 64;
+  }
+};
+
+struct uniform {
+  size_t n;
+  size_t operator()(rng& r) const { return r.below(n) + 1; }
+};
+
+// Ranks in [1, n] with P(k) ~ 1 / k^s, O(1) per sample for any s >= 0.
+struct zipf {
+  // reference : https://doi.org/10.1145/235025.235029
+  // (Hörmann and Derflinger, rejection-inversion)
+  size_t n;
+  double s;
+  double h_x1, h_n, threshold;
+
+  zipf(size_t n, double s)
+      : n(n), s(s),
+        h_x1(h_integral(1.5) - 1.0),
+        h_n(h_integral(static_cast<double>(n) + 0.5)),
+        threshold(2.0 - h_integral_inv(h_integral(2.5) - h(2.0))) {}
+
+  size_t operator()(rng& r) const {
+    for (;;) {
+      double u = h_n + r.uniform() * (h_x1 - h_n);
+      double x = h_integral_inv(u);
+      auto k = static_cast<size_t>(std::clamp(x + 0.5, 1.0, static_cast<double>(n)));
+      auto kd = static_cast<double>(k);
+      if (kd - x <= threshold || u >= h_integral(kd + 0.5) - h(kd))
+        return k;
+    }
+  }
+
+  double h(double x) const { return std::exp(-s * std::log(x)); }
+
+  double h_integral(double x) const {
+    double log_x = std::log(x);
+    return helper2((1.0 - s) * log_x) * log_x;
+  }
+
+  double h_integral_inv(double x) const {
+    double t = std::max(x * (1.0 - s), -1.0);
+    return std::exp(helper1(t) * x);
+  }
+
+  // log1p(x) / x and expm1(x) / x, stable around 0
+  static double helper1(double x) {
+    if (std::abs(x) > 1e-8) return std::log1p(x) / x;
+    return 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+  }
+  static double helper2(double x) {
+    if (std::abs(x) > 1e-8) return std::expm1(x) / x;
+    return 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+  }
+};
+
+struct spec {
+  std::string kind;
+  size_t n = 1'000'000;       // key space
+  size_t len = 1UL << 23;     // trace length
+  uint64_t seed = 0;
+  double s = 0.99;            // zipf skew
+  double hot = 0.2;           // hotspot: fraction of keys that are hot
+  double p = 0.8;             // hotspot: fraction of accesses to hot keys
+  double scan = 0.001;        // scan: probability an access starts a scan
+  size_t scan_len = 1024;     // scan: keys per scan
+  size_t ws = 1UL << 16;      // shift: working set size
+  size_t phase = 1UL << 20;   // shift: accesses per phase
+  size_t stride = 1UL << 15;  // shift: working set offset between phases
+};
+
+static const char* kinds[] = {"uniform", "zipf", "hotspot", "scan", "shift",
+                              "ycsb-a", "ycsb-b", "ycsb-c", "ycsb-d",
+                              "ycsb-e", "ycsb-f"};
+
+inline bool is_spec(std::string_view arg) {
+  auto kind = arg.substr(0, arg.find(':'));
+  return std::find(std::begin(kinds), std::end(kinds), kind) != std::end(kinds);
+}
+
+inline std::optional<spec> parse(std::string_view arg) {
+  if (!is_spec(arg)) return {};
+  spec sp;
+  auto colon = arg.find(':');
+  sp.kind = arg.substr(0, colon);
+  if (colon == std::string_view::npos) return sp;
+
+  for (auto rest = arg.substr(colon + 1); !rest.empty();) {
+    auto comma = rest.find(',');
+    auto param = rest.substr(0, comma);
+    rest = comma == std::string_view::npos ? "" : rest.substr(comma + 1);
+
+    auto eq = param.find('=');
+    auto name = param.substr(0, eq);
+    auto text = std::string(eq == std::string_view::npos ? "" : param.substr(eq + 1));
+    char* end = nullptr;
+    double val = std::strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0' || val < 0) {
+      std::cerr << "workload: bad value for '" << name << "'" << std::endl;
+      return {};
+    }
+    auto count = static_cast<size_t>(val);
+
+    if (name == "n") sp.n = count;
+    else if (name == "len") sp.len = count;
+    else if (name == "seed") sp.seed = count;
+    else if (name == "s") sp.s = val;
+    else if (name == "hot") sp.hot = val;
+    else if (name == "p") sp.p = val;
+    else if (name == "scan") sp.scan = val;
+    else if (name == "scan_len") sp.scan_len = count;
+    else if (name == "ws") sp.ws = count;
+    else if (name == "phase") sp.phase = count;
+    else if (name == "stride") sp.stride = count;
+    else {
+      std::cerr << "workload: unknown parameter '" << name << "'" << std::endl;
+      return {};
+    }
+  }
+  if (sp.n == 0 || sp.ws == 0 || sp.phase == 0 || sp.scan_len == 0 ||
+      sp.hot <= 0 || sp.hot > 1 || sp.p > 1 || sp.scan > 1) {
+    std::cerr << "workload: parameter out of range" << std::endl;
+    return {};
+  }
+  return sp;
+}
+
+static const size_t chunk_size = 1UL << 16;
+
+// Calls fn(rng, begin, end) for every chunk of [0, len), spread over all cores.
+template <typename Fn>
+void for_chunks(size_t len, uint64_t seed, Fn fn) {
+  size_t chunks = (len + chunk_size - 1) / chunk_size;
+  size_t num = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, chunks);
+
+  auto worker = [&](size_t t) {
+    for (size_t c = t; c < chunks; c += num) {
+      rng r(seed ^ mix(c));
+      fn(r, c * chunk_size, std::min(len, (c + 1) * chunk_size));
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < num; ++t) threads.emplace_back(worker, t);
+  worker(0);
+  for (auto& th : threads) th.join();
+}
+
+// Point lookups drawn from dist, with every access replaced with
+// probability scan by a sequential run of scan_len keys.
+template <typename Dist>
+void fill(const spec& sp, Dist dist, std::vector<size_t>& io) {
+  for_chunks(io.size(), sp.seed, [&](rng& r, size_t begin, size_t end) {
+    for (size_t i = begin; i < end;) {
+      if (sp.scan > 0 && r.uniform() < sp.scan) {
+        for (size_t key = r.below(sp.n), last = std::min(end, i + sp.scan_len);
+             i < last; ++i, key = (key + 1) % sp.n)
+          io[i] = key + 1;
+      } else {
+        io[i++] = dist(r);
+      }
+    }
+  });
+}
+
+// reference : https://github.com/brianfrankcooper/YCSB/wiki/Core-Workloads
+struct ycsb {
+  double read, update, insert, scan, rmw;
+  bool latest;
+};
+
+inline ycsb ycsb_mix(char w) {
+  switch (w) {
+    case 'a': return {0.5, 0.5, 0, 0, 0, false};
+    case 'b': return {0.95, 0.05, 0, 0, 0, false};
+    case 'c': return {1, 0, 0, 0, 0, false};
+    case 'd': return {0.95, 0, 0.05, 0, 0, true};
+    case 'e': return {0, 0, 0.05, 0.95, 0, false};
+    default: return {0.5, 0, 0, 0, 0.5, false};
+  }
+}
+
+// Records are keys [0, n), inserts append n, n + 1, ... in trace order.
+// Requests are scrambled zipfian, or zipfian over the most recent
+// inserts for "latest". Scans (E) emit up to 100 consecutive keys and a
+// read-modify-write (F) touches its key twice; both are cut at chunk ends.
+inline void fill_ycsb(const spec& sp, std::vector<size_t>& io) {
+  auto mix_ = ycsb_mix(sp.kind.back());
+  zipf dist(sp.n, sp.s);
+  size_t chunks = (io.size() + chunk_size - 1) / chunk_size;
+
+  // The operation of access i only depends on i, so the number of inserts
+  // preceding each chunk is known before any key is drawn.
+  auto is_insert = [&](size_t i) {
+    double u = static_cast<double>(mix(sp.seed ^ mix(i)) >> 11) * 0x1.0p-53;
+    return u >= mix_.read + mix_.update && u < mix_.read + mix_.update + mix_.insert;
+  };
+  std::vector<size_t> inserts(chunks + 1, 0);
+  if (mix_.insert > 0) {
+    for_chunks(io.size(), sp.seed, [&](rng&, size_t begin, size_t end) {
+      size_t count = 0;
+      for (size_t i = begin; i < end; ++i) count += is_insert(i);
+      inserts[begin / chunk_size + 1] = count;
+    });
+    std::partial_sum(inserts.begin(), inserts.end(), inserts.begin());
+  }
+
+  for_chunks(io.size(), sp.seed, [&](rng& r, size_t begin, size_t end) {
+    size_t records = sp.n + inserts[begin / chunk_size];
+    auto pick = [&]() -> size_t {
+      auto rank = dist(r) - 1;
+      if (mix_.latest) return records - 1 - std::min(rank, records - 1);
+      return mix(rank) % sp.n;
+    };
+    for (size_t i = begin; i < end;) {
+      double u = static_cast<double>(mix(sp.seed ^ mix(i)) >> 11) * 0x1.0p-53;
+      if (u < mix_.read + mix_.update) {
+        io[i++] = pick();
+      } else if (is_insert(i)) {
+        io[i++] = records++;
+      } else if (mix_.scan > 0) {
+        for (size_t key = pick(), last = std::min(end, i + 1 + r.below(100));
+             i < last; ++i, ++key)
+          io[i] = key;
+      } else {
+        auto key = pick();
+        for (auto last = std::min(end, i + 2); i < last; ++i)
+          io[i] = key;
+      }
+    }
+  });
+}
+
+inline std::vector<size_t> generate(const spec& sp) {
+  std::vector<size_t> io(sp.len);
+  if (sp.kind == "uniform") {
+    auto sp_ = sp;
+    sp_.scan = 0;
+    fill(sp_, uniform{sp.n}, io);
+  } else if (sp.kind == "zipf") {
+    auto sp_ = sp;
+    sp_.scan = 0;
+    fill(sp_, zipf(sp.n, sp.s), io);
+  } else if (sp.kind == "scan") {
+    fill(sp, zipf(sp.n, sp.s), io);
+  } else if (sp.kind == "hotspot") {
+    auto hot_keys = std::clamp<size_t>(sp.hot * sp.n, 1, sp.n);
+    auto cold_keys = sp.n - hot_keys;
+    auto sp_ = sp;
+    sp_.scan = 0;
+    fill(sp_, [&](rng& r) {
+      return !cold_keys || r.uniform() < sp.p ? r.below(hot_keys) + 1
+                                              : hot_keys + r.below(cold_keys) + 1;
+    }, io);
+  } else if (sp.kind == "shift") {
+    zipf dist(std::min(sp.ws, sp.n), sp.s);
+    for_chunks(io.size(), sp.seed, [&](rng& r, size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        auto base = (i / sp.phase) * sp.stride;
+        io[i] = (base + dist(r) - 1) % sp.n + 1;
+      }
+    });
+  } else {
+    fill_ycsb(sp, io);
+  }
+  return io;
+}
+
+};  // namespace workload